@@ -0,0 +1,253 @@
+/**
+   bench_parse.cpp
+   PSIL Parser Benchmark
+   Generates synthetic PSIL programs and times tokenizing, parsing and verifying them
+   Usage: bench_parse [scale]
+   @author Sinclair Gurny
+   @version 1.0
+   July 2019
+*/
+
+// Cpp includes
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <new>
+// C includes
+#include <cstdlib>
+#include <cstddef>
+#include <sys/resource.h>
+// PSIL
+#include "../src/psil_parser.h"
+#include "../src/psil_eval.h"
+
+// ====================== Heap Tracking ============================================
+
+// Bytes allocated through operator new, now and at most since last reset
+// Tokens come from arena chunks instead, see the arena column of bench
+static size_t heap_now = 0;
+static size_t heap_peak = 0;
+
+// Size is kept in front of each block
+static const size_t HEAP_HEADER = alignof( std::max_align_t );
+
+void * operator new( size_t n ) {
+  char * p = static_cast<char*>( std::malloc( n + HEAP_HEADER ) );
+  if ( p == nullptr ) { throw std::bad_alloc(); }
+  *reinterpret_cast<size_t*>( p ) = n;
+  heap_now += n;
+  if ( heap_now > heap_peak ) { heap_peak = heap_now; }
+  return p + HEAP_HEADER;
+}
+
+void operator delete( void * ptr ) noexcept {
+  if ( ptr == nullptr ) { return; }
+  char * p = static_cast<char*>( ptr ) - HEAP_HEADER;
+  heap_now -= *reinterpret_cast<size_t*>( p );
+  std::free( p );
+}
+
+void operator delete( void * ptr, size_t ) noexcept { operator delete( ptr ); }
+void * operator new[]( size_t n ) { return operator new( n ); }
+void operator delete[]( void * ptr ) noexcept { operator delete( ptr ); }
+void operator delete[]( void * ptr, size_t ) noexcept { operator delete( ptr ); }
+
+// ====================== Program Generators =======================================
+
+// (println (+ 1 (+ 1 ... 1)))
+std::string gen_deep( size_t n ) {
+  std::string ret = "(println ";
+  for ( size_t i = 0; i < n; ++i ) { ret += "(+ 1 "; }
+  ret += "1";
+  ret += std::string( n, ')' );
+  return ret + ")";
+}
+
+// (println (quote (0 1 2 ...)))
+std::string gen_flat( size_t n ) {
+  std::string ret = "(println (quote (";
+  for ( size_t i = 0; i < n; ++i ) { ret += std::to_string( i ) + " "; }
+  return ret + ")))";
+}
+
+// (begin (define v0 0) (define v1 1) ... (println v0))
+std::string gen_defines( size_t n ) {
+  std::string ret = "(begin ";
+  for ( size_t i = 0; i < n; ++i ) {
+    ret += "(define v" + std::to_string( i ) + " " + std::to_string( i ) + ") ";
+  }
+  return ret + "(println v0))";
+}
+
+// (quote ((a0 0 #t (#\a 0.5)) (a1 1 #f (#\a 1.5)) ...))
+std::string gen_quoted( size_t n ) {
+  std::string ret = "(quote (";
+  for ( size_t i = 0; i < n; ++i ) {
+    std::string num = std::to_string( i );
+    ret += "(a" + num + " " + num + ( i % 2 ? " #f" : " #t" ) + " (#\\a " + num + ".5)) ";
+  }
+  return ret + "))";
+}
+
+// ====================== Benchmark =================================================
+
+// Best time of running f reps times, in seconds
+double time_best( int reps, const std::function<void()> & f ) {
+  double best = 0;
+  for ( int i = 0; i < reps; ++i ) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    if ( i == 0 || d.count() < best ) { best = d.count(); }
+  }
+  return best;
+}
+
+// Steps of the clock a time must span for its rate to be printed, fewer are not precise to 1%
+const int MIN_STEPS = 100;
+
+// Shortest nonzero step of the clock, in seconds
+double clock_resolution() {
+  static double res = 0;
+  if ( res == 0 ) {
+    for ( int i = 0; i < 100; ++i ) {
+      auto start = std::chrono::steady_clock::now();
+      auto end = start;
+      while ( end == start ) { end = std::chrono::steady_clock::now(); }
+      std::chrono::duration<double> d = end - start;
+      if ( res == 0 || d.count() < res ) { res = d.count(); }
+    }
+  }
+  return res;
+}
+
+// Time each stage on a program and print one row of results
+void bench( const std::unique_ptr<psil_parser::language_t> & lang,
+	    const std::string & name, const std::string & code, int reps ) {
+  psil_parser::token_stream_t ts;
+  psil_parser::tokenize_input( code, ts );
+  size_t tokens = ts.tokens.size();
+
+  double t_tok = time_best( reps, [&]() { psil_parser::tokenize_input( code, ts ); } );
+
+  // Peak heap of a parse, above what is already allocated, and the chunks
+  // of a fresh arena holding its tokens
+  size_t parse_peak = 0, parse_arena = 0;
+  {
+    psil_parser::arena_t arena;
+    size_t base = heap_now;
+    heap_peak = heap_now;
+    auto tmp = psil_parser::parse( lang, code );
+    parse_peak = heap_peak - base;
+    parse_arena = arena.footprint();
+  }
+  auto ast = psil_parser::parse( lang, code );
+  if ( !ast ) {
+    std::cerr << "Generated program did not parse: " << name << std::endl;
+    exit(1);
+  }
+  double t_parse = time_best( reps, [&]() { ast = psil_parser::parse( lang, code ); } );
+
+  double t_check = time_best( reps, [&]() {
+				      try {
+					psil_eval::check_node( ast.get() );
+				      } catch ( std::string exp ) {
+					std::cerr << "Generated program did not verify: " << exp << std::endl;
+					exit(1);
+				      }
+				    } );
+
+  // Rate of a stage, "-" when its time is too short for the clock to measure
+  auto rate = [&]( double t ) {
+		if ( t < MIN_STEPS * clock_resolution() ) { return std::string( "-" ); }
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(3) << tokens / t / 1e6;
+		return out.str();
+	      };
+  std::cout << std::left << std::setw(10) << name << std::right
+	    << std::setw(9) << tokens
+	    << std::fixed << std::setprecision(3)
+	    << std::setw(11) << t_tok * 1e3 << std::setw(12) << rate( t_tok )
+	    << std::setw(11) << t_parse * 1e3 << std::setw(12) << rate( t_parse )
+	    << std::setw(11) << t_check * 1e3 << std::setw(12) << rate( t_check )
+	    << std::setw(10) << parse_peak / 1024 << std::setw(11) << parse_arena / 1024 << std::endl;
+}
+
+// ====================== Parser Parts ==============================================
+
+// Make every {regex} element run its regex, as if the scanner gave no token classes
+void drop_classes( const std::unique_ptr<psil_parser::language_t> & lang ) {
+  for ( auto & elem : lang->all_parsers ) {
+    for ( auto & rule_classes : elem.second->classes ) {
+      for ( auto & c : rule_classes ) { c = psil_parser::tok_kind::NONE; }
+    }
+  }
+}
+
+// Make every rule of a parser be tried, as if there were no dispatch tables
+void drop_tables( const std::unique_ptr<psil_parser::language_t> & lang ) {
+  for ( auto & elem : lang->all_parsers ) {
+    elem.second->first.clear();
+    elem.second->second.clear();
+  }
+}
+
+// Time parsing a program with the full parser and with each part turned off
+void bench_parts( const std::string & name, const std::string & code, int reps ) {
+  auto full = psil_parser::make_psil_lang();
+  auto no_classes = psil_parser::make_psil_lang();
+  drop_classes( no_classes );
+  auto no_tables = psil_parser::make_psil_lang();
+  drop_tables( no_tables );
+
+  auto time_parse = [&]( const std::unique_ptr<psil_parser::language_t> & lang ) {
+		      return time_best( reps, [&]() { psil_parser::parse( lang, code ); } );
+		    };
+  std::cout << std::left << std::setw(10) << name << std::right
+	    << std::fixed << std::setprecision(3)
+	    << std::setw(11) << time_parse( full ) * 1e3
+	    << std::setw(13) << time_parse( no_classes ) * 1e3
+	    << std::setw(13) << time_parse( no_tables ) * 1e3 << std::endl;
+}
+
+int main( int argc, char ** argv ) {
+  size_t scale = ( argc > 1 ) ? std::strtoul( argv[1], nullptr, 10 ) : 1;
+  if ( scale == 0 ) { scale = 1; }
+  const int reps = 5;
+
+  auto lang = psil_parser::make_psil_lang();
+
+  std::cout << "Times are best of " << reps << " runs in ms, rates in million tokens/s,\n"
+	    << "- when the time is too short for the clock to measure\n"
+	    << "parse includes its own tokenizing\n"
+	    << "heap is the peak of operator new during a parse, arena the chunks its tokens took\n\n";
+  std::cout << std::left << std::setw(10) << "shape" << std::right
+	    << std::setw(9) << "tokens"
+	    << std::setw(11) << "tokenize" << std::setw(12) << "Mtok/s"
+	    << std::setw(11) << "parse" << std::setw(12) << "Mtok/s"
+	    << std::setw(11) << "check" << std::setw(12) << "Mtok/s"
+	    << std::setw(10) << "heap KiB" << std::setw(11) << "arena KiB" << std::endl;
+
+  bench( lang, "deep", gen_deep( 200 * scale ), reps );
+  bench( lang, "flat", gen_flat( 20000 * scale ), reps );
+  bench( lang, "defines", gen_defines( 5000 * scale ), reps );
+  bench( lang, "quoted", gen_quoted( 3000 * scale ), reps );
+
+  std::cout << "\nParse in ms without the scanner's token classes or the dispatch tables\n\n";
+  std::cout << std::left << std::setw(10) << "shape" << std::right
+	    << std::setw(11) << "full" << std::setw(13) << "no classes"
+	    << std::setw(13) << "no tables" << std::endl;
+  bench_parts( "deep", gen_deep( 200 * scale ), reps );
+  bench_parts( "flat", gen_flat( 20000 * scale ), reps );
+  bench_parts( "defines", gen_defines( 5000 * scale ), reps );
+  bench_parts( "quoted", gen_quoted( 3000 * scale ), reps );
+
+  struct rusage ru;
+  getrusage( RUSAGE_SELF, &ru );
+  std::cout << "\nPeak resident memory: " << ru.ru_maxrss << " KiB" << std::endl;
+  return 0;
+}
@@ -0,0 +1,90 @@
+/**
+    psil_arena.cpp
+    PSIL Token Arena Implementation
+    @author Sinclair Gurny
+    @version 1.0
+    July 2019
+*/
+
+#include "psil_arena.h"
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+namespace psil_parser {
+
+  arena_t * arena_t::cur = nullptr;
+
+  // === Become current arena
+  arena_t::arena_t() : chunks(), big(), big_bytes(0), free_lists(), strs(nullptr), bump(nullptr),
+		       bump_end(nullptr), dropping(false), prev(cur) {
+    cur = this;
+  }
+
+  // === Release every chunk at once and restore previous arena
+  arena_t::~arena_t() {
+    for ( str_block_t * b = strs; b != nullptr; b = b->next ) { b->str.~basic_string(); } // text may be on the heap
+    for ( char * c : chunks ) { std::free( c ); }
+    for ( void * b : big ) { std::free( b ); }
+    if ( cur == this ) { cur = prev; }
+  }
+
+  // === Arena that is never released, it is only current through use_t
+  arena_t & arena_t::permanent() {
+    static arena_t * perm = nullptr;
+    if ( perm == nullptr ) {
+      perm = new arena_t();
+      cur = perm->prev;
+    }
+    return *perm;
+  }
+
+  // === Copy string into a block of this arena, linked so the arena can destroy it
+  const std::string * arena_t::new_str( std::string_view s ) {
+    auto b = new ( alloc( sizeof( str_block_t ) ) ) str_block_t{ std::string( s ), nullptr, strs };
+    if ( strs != nullptr ) { strs->prev = b; }
+    strs = b;
+    return &b->str;
+  }
+
+  // === Unlink and destroy string, a dropped arena destroys its strings when it is released
+  void arena_t::free_str( const std::string * s ) {
+    static_assert( std::is_standard_layout<str_block_t>::value, "str must start its block" );
+    auto b = reinterpret_cast<str_block_t*>( const_cast<std::string*>( s ) );
+    arena_t & a = owner( b, sizeof( str_block_t ) );
+    if ( a.dropping ) { return; }
+    if ( b->prev != nullptr ) { b->prev->next = b->next; } else { a.strs = b->next; }
+    if ( b->next != nullptr ) { b->next->prev = b->prev; }
+    b->~str_block_t();
+    a.free( b, sizeof( str_block_t ) );
+  }
+
+  // === Start bumping from a new chunk, rest of old chunk is abandoned
+  void arena_t::new_chunk() {
+    char * c = static_cast<char*>( std::aligned_alloc( CHUNK_SIZE, CHUNK_SIZE ) );
+    if ( c == nullptr ) { throw std::bad_alloc(); }
+    chunks.push_back( c );
+    *reinterpret_cast<arena_t**>( c ) = this;
+    bump = c + ALIGN;
+    bump_end = c + CHUNK_SIZE;
+  }
+
+  // === Blocks too large to pool are allocated alone, after a header holding the arena
+  void * arena_t::alloc_big( size_t n ) {
+    char * b = static_cast<char*>( std::aligned_alloc( ALIGN, ALIGN + big_size( n ) ) );
+    if ( b == nullptr ) { throw std::bad_alloc(); }
+    *reinterpret_cast<arena_t**>( b ) = this;
+    big.insert( b );
+    big_bytes += ALIGN + big_size( n );
+    return b + ALIGN;
+  }
+
+  void arena_t::free_big( void * p, size_t n ) {
+    void * b = static_cast<char*>( p ) - ALIGN;
+    if ( big.erase( b ) > 0 ) {
+      std::free( b );
+      big_bytes -= ALIGN + big_size( n );
+    }
+  }
+
+}
@@ -0,0 +1,145 @@
+/**
+    psil_arena.h
+    PSIL Token Arena
+    @author Sinclair Gurny
+    @version 1.0
+    July 2019
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_set>
+
+namespace psil_parser {
+
+  /**
+     Arena
+     Allocates the tokens of one evaluation
+     Blocks are bumped out of large chunks, freed blocks are kept on a free list
+       per size for reuse, and every chunk is released at once with the arena
+     Chunks are aligned to their size and start with the arena owning them,
+       large blocks have it in front, so a block is always freed to its own arena
+     Constructing an arena makes it current until it is destroyed,
+       tokens made while no arena exists come from a default arena
+     After drop is called, tokens are no longer freed one by one,
+       which lets the arena release whole trees in one step
+     The permanent arena is never released, it holds tokens shared by every evaluation
+     Strings made while running are kept in the arena as well, those left when it is
+       released are destroyed with it
+  */
+  class arena_t {
+  public:
+    arena_t();
+    ~arena_t();
+    arena_t( const arena_t & ) = delete;
+    arena_t & operator=( const arena_t & ) = delete;
+
+    // Allocate block of n bytes
+    void * alloc( size_t n ) {
+      size_t c = ( n + ALIGN - 1 ) / ALIGN;
+      if ( c >= NUM_CLASSES ) { return alloc_big( n ); }
+      if ( free_lists[c] != nullptr ) { // reuse freed block
+	free_block_t * b = free_lists[c];
+	free_lists[c] = b->next;
+	return b;
+      }
+      size_t bytes = c * ALIGN;
+      if ( bump + bytes > bump_end ) { new_chunk(); }
+      void * ret = bump;
+      bump += bytes;
+      return ret;
+    }
+
+    // Give back block of n bytes allocated from this arena
+    void free( void * p, size_t n ) {
+      if ( p == nullptr || dropping ) { return; }
+      size_t c = ( n + ALIGN - 1 ) / ALIGN;
+      if ( c >= NUM_CLASSES ) { free_big( p, n ); return; }
+      free_block_t * b = static_cast<free_block_t*>( p );
+      b->next = free_lists[c];
+      free_lists[c] = b;
+    }
+
+    // Copy of s kept in this arena until free_str is called or the arena is released
+    const std::string * new_str( std::string_view s );
+    // Destroy string made by new_str, in the arena that made it
+    static void free_str( const std::string * s );
+
+    // Bytes taken from the system, blocks on the free lists included
+    size_t footprint() const { return chunks.size() * CHUNK_SIZE + big_bytes; }
+
+    void drop() { dropping = true; }
+    bool is_dropping() const { return dropping; }
+
+    static arena_t & current() {
+      if ( cur == nullptr ) { cur = new arena_t(); } // default arena, never released
+      return *cur;
+    }
+
+    static arena_t & permanent();
+
+    // Arena a block of n bytes was allocated from
+    static arena_t & owner( const void * p, size_t n ) {
+      uintptr_t a = reinterpret_cast<uintptr_t>( p );
+      if ( ( n + ALIGN - 1 ) / ALIGN >= NUM_CLASSES ) { a -= ALIGN; } // header of large block
+      else { a &= ~uintptr_t( CHUNK_SIZE - 1 ); } // start of chunk
+      return **reinterpret_cast<arena_t**>( a );
+    }
+
+    /**
+       Makes an arena current while the guard lives
+    */
+    class use_t {
+    public:
+      use_t( arena_t & a ) : prev( cur ) { cur = &a; }
+      ~use_t() { cur = prev; }
+      use_t( const use_t & ) = delete;
+      use_t & operator=( const use_t & ) = delete;
+    private:
+      arena_t * prev;
+    };
+
+  private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    static const size_t ALIGN = 16;
+    static const size_t NUM_CLASSES = 64; // blocks below 1 KiB are pooled
+
+    struct free_block_t { free_block_t * next; };
+    // String of new_str, linked into the list of strings of its arena
+    struct str_block_t {
+      std::string str;
+      str_block_t * prev;
+      str_block_t * next;
+    };
+
+    void new_chunk();
+    void * alloc_big( size_t n );
+    void free_big( void * p, size_t n );
+    static size_t big_size( size_t n ) { return ( n + ALIGN - 1 ) / ALIGN * ALIGN; }
+
+    std::vector<char*> chunks;
+    std::unordered_set<void*> big;
+    size_t big_bytes;
+    free_block_t * free_lists[NUM_CLASSES];
+    str_block_t * strs;
+    char * bump;
+    char * bump_end;
+    bool dropping;
+    arena_t * prev;
+
+    static arena_t * cur;
+  };
+
+  // Allocate from current arena
+  inline void * arena_alloc( size_t n ) { return arena_t::current().alloc( n ); }
+  // Free to arena the block came from
+  inline void arena_free( void * p, size_t n ) {
+    if ( p != nullptr ) { arena_t::owner( p, n ).free( p, n ); }
+  }
+
+}
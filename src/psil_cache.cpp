@@ -0,0 +1,282 @@
+/**
+    psil_cache.cpp
+    PSIL Compiled AST Cache Implementation
+    @author Sinclair Gurny
+    @version 1.0
+    July 2019
+*/
+
+#include "psil_cache.h"
+#include <cstdio>
+#include <cstring>
+// C includes
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace psil_cache {
+
+  // Cache file layout:
+  //   "PSILC" version:u8 hash:u64 size:u64 body_hash:u64
+  //   ( FORM_TAG token )* END_TAG
+  // body_hash is FNV-1a of everything after the header
+  // token:  type_name:str head:u8 vtype:u8 count:varint ( STR_TAG str | TOKEN_TAG token )*
+  // str:    ( length:varint << 1 ) bytes, or ( index:varint << 1 | 1 ) of an earlier str
+  static const char MAGIC[5] = { 'P', 'S', 'I', 'L', 'C' };
+  static const size_t HEADER_SIZE = sizeof(MAGIC) + 1 + 8 + 8 + 8;
+  enum : unsigned char { END_TAG = 0, FORM_TAG = 1 };
+  enum : unsigned char { STR_TAG = 0, TOKEN_TAG = 1 };
+  // Deepest token accepted, guards against corrupt files
+  static const size_t MAX_DEPTH = 1 << 16;
+
+  static const uint64_t FNV_BASIS = 14695981039346656037ull;
+
+  // Continue FNV-1a hash h over bytes
+  static uint64_t fnv_add( uint64_t h, std::string_view bytes ) {
+    for ( unsigned char c : bytes ) { h = ( h ^ c ) * 1099511628211ull; }
+    return h;
+  }
+
+  // === FNV-1a over every byte of the source
+  uint64_t hash_source( std::string_view src ) {
+    return fnv_add( FNV_BASIS, src );
+  }
+
+  // === Cache file is kept next to the source
+  std::string cache_path( const std::string & filename ) {
+    return filename + "c";
+  }
+
+  // ========== Writer ===============================================
+
+  // Start cache file with header
+  cache_writer_t::cache_writer_t( const std::string & p, uint64_t hash, uint64_t size ) :
+    path(p), tmp_path(p + ".tmp"), out(tmp_path, std::ios::binary | std::ios::trunc),
+    done(false), strings(), body_hash( FNV_BASIS ) {
+    if ( !out.good() ) { return; }
+    out.write( MAGIC, sizeof(MAGIC) );
+    out.put( static_cast<char>( FORMAT_VERSION ) );
+    write_u64( hash );
+    write_u64( size );
+    write_u64( 0 ); // body hash, filled in by finish
+  }
+
+  // Unfinished cache files are removed
+  cache_writer_t::~cache_writer_t() {
+    if ( !done ) {
+      out.close();
+      std::remove( tmp_path.c_str() );
+    }
+  }
+
+  // Whether every write has succeeded so far
+  bool cache_writer_t::good() const {
+    return out.good();
+  }
+
+  // Add form to cache
+  void cache_writer_t::add( const psil_parser::token_t * form ) {
+    if ( !out.good() ) { return; }
+    put( FORM_TAG );
+    write_token( form );
+  }
+
+  // === End cache file and move it in place of the old one
+  bool cache_writer_t::finish() {
+    if ( !out.good() ) { return false; }
+    put( END_TAG );
+    out.seekp( HEADER_SIZE - 8 );
+    write_u64( body_hash );
+    out.close();
+    if ( out.fail() || std::rename( tmp_path.c_str(), path.c_str() ) != 0 ) {
+      return false;
+    }
+    done = true;
+    return true;
+  }
+
+  // Byte of the body, added to its hash
+  void cache_writer_t::put( unsigned char c ) {
+    out.put( static_cast<char>( c ) );
+    body_hash = ( body_hash ^ c ) * 1099511628211ull;
+  }
+
+  // Little endian integer of the header
+  void cache_writer_t::write_u64( uint64_t v ) {
+    for ( int i = 0; i < 8; ++i ) { out.put( static_cast<char>( v >> (8*i) ) ); }
+  }
+
+  // LEB128 encoded integer
+  void cache_writer_t::write_varint( uint64_t v ) {
+    while ( v >= 0x80 ) {
+      put( ( v & 0x7f ) | 0x80 );
+      v >>= 7;
+    }
+    put( v );
+  }
+
+  // Strings are written once, repeats refer to the first one
+  void cache_writer_t::write_str( const std::string & s ) {
+    auto itr = strings.find( s );
+    if ( itr != strings.end() ) {
+      write_varint( ( itr->second << 1 ) | 1 );
+      return;
+    }
+    strings.insert( std::make_pair( s, strings.size() ) );
+    write_varint( uint64_t( s.size() ) << 1 );
+    out.write( s.data(), s.size() );
+    body_hash = fnv_add( body_hash, s );
+  }
+
+  void cache_writer_t::write_token( const psil_parser::token_t * tk ) {
+    write_str( tk->type_name() );
+    put( static_cast<unsigned char>( tk->head ) );
+    put( static_cast<unsigned char>( tk->vtype ) );
+    write_varint( tk->aspects.size() );
+    for ( auto & elem : tk->aspects ) {
+      if ( elem.elem_type == psil_parser::token_elem_t::TE_Type::STRING ) {
+	put( STR_TAG );
+	write_str( elem.str() );
+      } else {
+	put( TOKEN_TAG );
+	write_token( elem.tk.get() );
+      }
+    }
+  }
+
+  // ========== Reader ===============================================
+
+  // === Map cache file and check it belongs to the source
+  cache_reader_t::cache_reader_t( const std::string & path, uint64_t hash, uint64_t src_size ) :
+    data(nullptr), size(0), pos(0), valid(false), strings(), num_strings(0) {
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) { return; }
+    struct stat st;
+    if ( fstat( fd, &st ) == 0 && static_cast<size_t>( st.st_size ) > HEADER_SIZE ) {
+      void * m = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if ( m != MAP_FAILED ) {
+	data = static_cast<const unsigned char*>( m );
+	size = st.st_size;
+      }
+    }
+    close( fd );
+    if ( data == nullptr ) { return; }
+
+    // Check header
+    if ( std::memcmp( data, MAGIC, sizeof(MAGIC) ) != 0 ) { return; }
+    pos = sizeof(MAGIC);
+    if ( data[pos++] != FORMAT_VERSION ) { return; }
+    uint64_t file_hash = 0, file_size = 0, body_hash = 0;
+    for ( int i = 0; i < 8; ++i ) { file_hash |= uint64_t( data[pos++] ) << (8*i); }
+    for ( int i = 0; i < 8; ++i ) { file_size |= uint64_t( data[pos++] ) << (8*i); }
+    for ( int i = 0; i < 8; ++i ) { body_hash |= uint64_t( data[pos++] ) << (8*i); }
+    if ( file_hash != hash || file_size != src_size ) { return; }
+
+    // Check body was not changed since it was written
+    std::string_view body( reinterpret_cast<const char*>( data + pos ), size - pos );
+    if ( fnv_add( FNV_BASIS, body ) != body_hash ) { return; }
+
+    // Walk every form once, so reading them later cannot run off the end
+    size_t start = pos;
+    num_strings = 0;
+    while ( pos < size && data[pos] == FORM_TAG ) {
+      ++pos;
+      if ( !skip_token( 0 ) ) { return; }
+    }
+    if ( pos + 1 != size || data[pos] != END_TAG ) { return; }
+    pos = start;
+    valid = true;
+  }
+
+  cache_reader_t::~cache_reader_t() {
+    if ( data != nullptr ) { munmap( const_cast<unsigned char*>( data ), size ); }
+  }
+
+  // Whether cache file is valid for the source
+  bool cache_reader_t::good() const {
+    return valid;
+  }
+
+  // === Read next form, nullptr after the last one
+  psil_parser::token_ptr cache_reader_t::next() {
+    if ( !valid || data[pos] != FORM_TAG ) { return nullptr; }
+    ++pos;
+    return read_token();
+  }
+
+  // LEB128 encoded integer, 0 if it runs off the end
+  uint64_t cache_reader_t::read_varint() {
+    uint64_t v = 0;
+    for ( int shift = 0; pos < size && shift < 64; shift += 7 ) {
+      unsigned char b = data[pos++];
+      v |= uint64_t( b & 0x7f ) << shift;
+      if ( !( b & 0x80 ) ) { return v; }
+    }
+    pos = size;
+    return 0;
+  }
+
+  std::string cache_reader_t::read_str() {
+    uint64_t v = read_varint();
+    if ( v & 1 ) { return std::string( strings[ v >> 1 ] ); }
+    size_t len = v >> 1;
+    strings.push_back( std::string_view( reinterpret_cast<const char*>( data + pos ), len ) );
+    pos += len;
+    return std::string( strings.back() );
+  }
+
+  psil_parser::token_ptr cache_reader_t::read_token() {
+    psil_parser::token_ptr tk( new psil_parser::token_t( read_str() ) );
+    tk->head = static_cast<psil_parser::head_kind>( data[pos++] );
+    tk->vtype = static_cast<psil_parser::VarType>( data[pos++] );
+    size_t count = read_varint();
+    tk->aspects.reserve( count );
+    for ( size_t i = 0; i < count; ++i ) {
+      if ( data[pos++] == STR_TAG ) {
+	tk->add_leaf( read_str() );
+      } else {
+	tk->aspects.emplace_back( read_token() );
+      }
+    }
+    if ( tk->kind == psil_parser::node_kind::INTEGER || tk->kind == psil_parser::node_kind::DECIMAL ) {
+      psil_parser::read_number( tk.get() );
+    }
+    return tk;
+  }
+
+  // Move past token, checking it lies within the file
+  bool cache_reader_t::skip_token( size_t depth ) {
+    if ( depth > MAX_DEPTH ) { return false; }
+    auto skip_str = [&]() -> bool {
+		      uint64_t v = read_varint();
+		      if ( pos >= size ) { return false; }
+		      if ( v & 1 ) { return ( v >> 1 ) < num_strings; }
+		      if ( ( v >> 1 ) > size - pos ) { return false; }
+		      pos += v >> 1;
+		      ++num_strings;
+		      return true;
+		    };
+    if ( !skip_str() ) { return false; }
+    if ( pos >= size || data[pos++] > static_cast<unsigned char>( psil_parser::head_kind::QUOTE ) ) {
+      return false;
+    }
+    if ( pos >= size || data[pos++] > static_cast<unsigned char>( psil_parser::VarType::ERROR ) ) {
+      return false;
+    }
+    size_t count = read_varint();
+    for ( size_t i = 0; i < count; ++i ) {
+      if ( pos >= size ) { return false; }
+      unsigned char tag = data[pos++];
+      if ( tag == STR_TAG ) {
+	if ( !skip_str() ) { return false; }
+      } else if ( tag == TOKEN_TAG ) {
+	if ( !skip_token( depth+1 ) ) { return false; }
+      } else {
+	return false;
+      }
+    }
+    return pos < size;
+  }
+
+}
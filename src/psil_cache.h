@@ -0,0 +1,96 @@
+/**
+    psil_cache.h
+    PSIL Compiled AST Cache Library
+    @author Sinclair Gurny
+    @version 1.0
+    July 2019
+ */
+
+#pragma once
+
+#include "psil_parser.h"
+#include <cstdint>
+#include <fstream>
+
+namespace psil_cache {
+
+  // Version of the cache file layout, bump when the AST layout changes
+  constexpr uint8_t FORMAT_VERSION = 4;
+
+  /**
+     Hashes source code, used to tell if a cache file is stale
+     @param src - contents of source file
+     @return 64 bit FNV-1a hash of the source
+  */
+  uint64_t hash_source( std::string_view src );
+
+  /**
+     Finds where the cache file of a source file is kept
+     @param filename - path of .psil file
+     @return path of .psilc file next to the source
+  */
+  std::string cache_path( const std::string & filename );
+
+  /**
+     Cache Writer
+     Writes checked top level forms of a source file to a temporary file,
+     which replaces the cache file once every form was added
+     A hash of everything written after the header is kept in the header
+  */
+  class cache_writer_t {
+  public:
+    cache_writer_t( const std::string & path, uint64_t hash, uint64_t size );
+    ~cache_writer_t();
+    cache_writer_t( const cache_writer_t & ) = delete;
+    cache_writer_t & operator=( const cache_writer_t & ) = delete;
+
+    bool good() const;
+    void add( const psil_parser::token_t * form );
+    bool finish();
+
+  private:
+    void put( unsigned char c );
+    void write_u64( uint64_t v );
+    void write_varint( uint64_t v );
+    void write_str( const std::string & s );
+    void write_token( const psil_parser::token_t * tk );
+
+    std::string path;
+    std::string tmp_path;
+    std::ofstream out;
+    bool done;
+    std::unordered_map<std::string, uint64_t> strings;
+    uint64_t body_hash;
+  };
+
+  /**
+     Cache Reader
+     Maps a cache file into memory and reads back its forms,
+     the whole file is validated when opened, so reading never fails
+     Files whose body does not match the hash in their header are not valid
+  */
+  class cache_reader_t {
+  public:
+    cache_reader_t( const std::string & path, uint64_t hash, uint64_t size );
+    ~cache_reader_t();
+    cache_reader_t( const cache_reader_t & ) = delete;
+    cache_reader_t & operator=( const cache_reader_t & ) = delete;
+
+    bool good() const;
+    psil_parser::token_ptr next();
+
+  private:
+    uint64_t read_varint();
+    std::string read_str();
+    psil_parser::token_ptr read_token();
+    bool skip_token( size_t depth );
+
+    const unsigned char * data;
+    size_t size;
+    size_t pos;
+    bool valid;
+    std::vector<std::string_view> strings;
+    uint64_t num_strings;
+  };
+
+}
@@ -12,28 +12,28 @@ namespace psil_eval {
 
   // Check expression for semantic erros
   bool check_expression( psil_parser::token_t * node ) {
-    if ( node->aspects.size() == 1 && node->aspects.front()->elem_type == TE_Type::TOKEN ) {
-      if ( node->aspects.front()->tk->type_name == "<constant>" ) {
+    if ( node->aspects.size() == 1 && node->aspects.front().elem_type == TE_Type::TOKEN ) {
+      NK kind = node->aspects.front().tk->kind;
+      if ( kind == NK::CONSTANT ) {
 	return true;
-      } else if ( node->aspects.front()->tk->type_name == "<variable>" ) {
+      } else if ( kind == NK::VARIABLE ) {
 	return true;
-      } else if ( node->aspects.front()->tk->type_name == "<lambda>" ) {
-	return check_lambda( node->aspects.front()->tk.get() );
-      } else if ( node->aspects.front()->tk->type_name == "<conditional>" ||
-		  node->aspects.front()->tk->type_name == "<application>" ) {
-	auto tmp = node->aspects.front()->tk.get();
+      } else if ( kind == NK::LAMBDA ) {
+	return check_lambda( node->aspects.front().tk.get() );
+      } else if ( kind == NK::CONDITIONAL || kind == NK::APPLICATION ) {
+	auto tmp = node->aspects.front().tk.get();
 	for ( auto itr = tmp->aspects.begin(); itr != tmp->aspects.end(); ++itr ) {
 	  // Recurse on expressions
-	  if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	    if ( !check_node( (*itr)->tk.get() ) ) return false;
+	  if ( itr->elem_type == TE_Type::TOKEN ) {
+	    if ( !check_node( itr->tk.get() ) ) return false;
 	  }
 	}	
       }
     } else { // (begin <expr>+)
       for ( auto itr = node->aspects.begin(); itr != node->aspects.end(); ++itr ) {
 	// Recurse on expressions
-	if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	  if ( !check_node( (*itr)->tk.get() ) ) return false;
+	if ( itr->elem_type == TE_Type::TOKEN ) {
+	  if ( !check_node( itr->tk.get() ) ) return false;
 	}
       }
     }
@@ -44,23 +44,23 @@ namespace psil_eval {
   // Check lambda expressions for semantic errors
   bool check_lambda( psil_parser::token_t * node ) {
     // Grab <formals> aspect
-    auto lambda_args = node->aspects[2]->tk.get();
+    auto lambda_args = node->aspects[2].tk.get();
     for ( auto itr = lambda_args->aspects.begin(); itr != lambda_args->aspects.end(); ++itr ) {
       // Look for variables in <formals>
-      if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	auto var = (*itr)->tk.get();
-	if ( !var->aspects.empty() && var->aspects.front()->elem_type ==
+      if ( itr->elem_type == TE_Type::TOKEN ) {
+	auto var = itr->tk.get();
+	if ( !var->aspects.empty() && var->aspects.front().elem_type ==
 	     TE_Type::TOKEN ) {
 	  // grab <identifier> aspect
-	  auto iden = var->aspects.front()->tk.get();
+	  auto iden = var->aspects.front().tk.get();
 	  // check for <operator> or <keyword>
-	  if ( !iden->aspects.empty() && iden->aspects.front()->elem_type ==
+	  if ( !iden->aspects.empty() && iden->aspects.front().elem_type ==
 	       TE_Type::TOKEN ) {
-	    auto var_type = iden->aspects.front()->tk.get();
-	    if ( var_type->type_name == "<operator>" ) {
+	    auto var_type = iden->aspects.front().tk.get();
+	    if ( var_type->kind == NK::OPERATOR ) {
 	      throw std::string( "Cannot bind operator as lambda argument" );
 	      return false;
-	    } else if ( var_type->type_name == "<keyword>" ) {
+	    } else if ( var_type->kind == NK::KEYWORD ) {
 	      throw std::string( "Cannot bind keyword as lambda argument" );
 	      return false;
 	    }
@@ -69,10 +69,10 @@ namespace psil_eval {
       }
     }
     // === Recurse on body of lambda ===
-    auto body = node->aspects[3]->tk.get();
+    auto body = node->aspects[3].tk.get();
     for ( auto itr = body->aspects.begin(); itr != body->aspects.end(); ++itr ) {
-      if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	if ( !check_node( (*itr)->tk.get() ) ) return false;
+      if ( itr->elem_type == TE_Type::TOKEN ) {
+	if ( !check_node( itr->tk.get() ) ) return false;
       }
     }
     return true;
@@ -83,26 +83,26 @@ namespace psil_eval {
   bool check_definition( psil_parser::token_t * node ) {
     // === Check on variable capturing ===
     // grab <variable> aspect
-    auto var = node->aspects[2]->tk.get();
-    if ( !var->aspects.empty() && var->aspects.front()->elem_type ==
+    auto var = node->aspects[2].tk.get();
+    if ( !var->aspects.empty() && var->aspects.front().elem_type ==
 	 TE_Type::TOKEN ) {
       // grab <identifier> aspect
-      auto iden = var->aspects.front()->tk.get();
+      auto iden = var->aspects.front().tk.get();
       // check for <operator> or <keyword>
-      if ( !iden->aspects.empty() && iden->aspects.front()->elem_type ==
+      if ( !iden->aspects.empty() && iden->aspects.front().elem_type ==
 	   TE_Type::TOKEN ) {
-	auto var_type = iden->aspects.front()->tk.get();
-	if ( var_type->type_name == "<operator>" ) {
+	auto var_type = iden->aspects.front().tk.get();
+	if ( var_type->kind == NK::OPERATOR ) {
 	  throw std::string( "Cannot redefine operators" );
 	  return false;
-	} else if ( var_type->type_name == "<keyword>" ) {
+	} else if ( var_type->kind == NK::KEYWORD ) {
 	  throw std::string( "Cannot define keywords" );
 	  return false;
 	}
       }
     }
     // === Recurse on rest of definition ===
-    return check_node( node->aspects[3]->tk.get() );
+    return check_node( node->aspects[3].tk.get() );
   }
 
 
@@ -110,22 +110,224 @@ namespace psil_eval {
   bool check_node( psil_parser::token_t * node ) {
     if ( node == nullptr ) {
       throw std::string( "Given nullptr as AST" );
-    } else if ( node->type_name == "<program>" ) {
-      if ( !node->aspects.empty() &&  node->aspects.front()->elem_type == TE_Type::TOKEN )
-	return check_node( node->aspects.front()->tk.get() );
-    } else if ( node->type_name == "<form>" ) {
+    }
+    switch ( node->kind ) {
+    case NK::PROGRAM:
+      if ( !node->aspects.empty() &&  node->aspects.front().elem_type == TE_Type::TOKEN )
+	return check_node( node->aspects.front().tk.get() );
+      break;
+    case NK::FORM:
       for ( auto itr = node->aspects.begin(); itr != node->aspects.end(); ++itr ) {
-	if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	  if ( !check_node( (*itr)->tk.get() ) ) return false;
+	if ( itr->elem_type == TE_Type::TOKEN ) {
+	  if ( !check_node( itr->tk.get() ) ) return false;
 	}
       }
-    } else if ( node->type_name == "<expression>" ) {
+      break;
+    case NK::EXPRESSION:
       return check_expression( node );
-    } else if ( node->type_name == "<definition>" ) {
+    case NK::DEFINITION:
       return check_definition( node );
+    default:
+      break;
     }
     // Do not expand other types of tokens
     return true;
   }
 
+  // Head of compound node from its keyword, the string after its open paren
+  static psil_parser::head_kind find_head( psil_parser::token_t * node ) {
+    if ( node->aspects.size() < 2 || node->aspects[1].elem_type != TE_Type::STRING ) {
+      return HK::PAREN;
+    }
+    const std::string & key = node->aspects[1].str();
+    if ( key == "begin" ) return HK::BEGIN;
+    if ( key == "define" ) return HK::DEFINE;
+    if ( key == "update" ) return HK::UPDATE;
+    if ( key == "lambda" ) return HK::LAMBDA;
+    if ( key == "cond" ) return HK::COND;
+    if ( key == "if" ) return HK::IF;
+    if ( key == "quote" ) return HK::QUOTE;
+    return HK::PAREN; // closing paren of ()
+  }
+
+  // Lower node and its children
+  void lower_node( psil_parser::token_t * node ) {
+    switch ( node->kind ) {
+    case NK::FORM: case NK::DEFINITION: case NK::EXPRESSION: case NK::LAMBDA:
+    case NK::FORMALS: case NK::CONDITIONAL: case NK::APPLICATION: case NK::LIST_DEF:
+    case NK::LIST:
+      // Compound nodes hold strings only when they are parenthesized
+      if ( !node->aspects.empty() && node->aspects.front().elem_type == TE_Type::STRING ) {
+	node->head = find_head( node );
+	auto itr = node->aspects.begin();
+	while ( itr != node->aspects.end() ) {
+	  if ( itr->elem_type == TE_Type::STRING ) {
+	    itr = node->aspects.erase( itr );
+	  } else {
+	    ++itr;
+	  }
+	}
+      }
+      break;
+    default:
+      break;
+    }
+    for ( auto & elem : node->aspects ) {
+      if ( elem.elem_type == TE_Type::TOKEN ) { lower_node( elem.tk.get() ); }
+    }
+    if ( node->kind == NK::INTEGER || node->kind == NK::DECIMAL ) {
+      psil_parser::read_number( node ); // numbers are parsed once, here
+    } else {
+      node->vtype = value_type( node );
+    }
+  }
+
+  // Type of constant or datum, from the kind of its value
+  psil_parser::VarType value_type( const psil_parser::token_t * node ) {
+    using VT = psil_parser::VarType;
+    if ( node->aspects.size() != 1 || node->aspects.front().elem_type != TE_Type::TOKEN ) {
+      return VT::UNKNOWN;
+    }
+    auto value = node->aspects.front().tk.get();
+    if ( node->kind == NK::CONSTANT ) {
+      switch ( value->kind ) {
+      case NK::BOOLEAN: return VT::BOOL;
+      case NK::NUMBER: return VT::NUM;
+      case NK::CHARACTER: return VT::CHAR;
+      case NK::LIST_DEF: // quoted datum
+	if ( value->aspects.empty() || value->aspects.front().elem_type != TE_Type::TOKEN ) {
+	  return VT::ERROR;
+	}
+	return value_type( value->aspects.front().tk.get() );
+      default: return VT::ERROR;
+      }
+    } else if ( node->kind == NK::DATUM ) {
+      switch ( value->kind ) {
+      case NK::BOOLEAN: return VT::BOOL;
+      case NK::NUMBER: return VT::NUM;
+      case NK::CHARACTER: return VT::CHAR;
+      case NK::SYMBOL: return VT::SYMBOL;
+      case NK::LIST: return VT::LIST;
+      default: break;
+      }
+    }
+    return VT::UNKNOWN;
+  }
+
+  // Hash of token's structure, equal trees hash the same
+  //  kept on constants and datums, whose trees change only after being owned
+  uint32_t hash_tree( psil_parser::token_t * node ) {
+    if ( node->hash != 0 ) return node->hash;
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h]( uint64_t v ) { h = ( h ^ v ) * 1099511628211ull; };
+    mix( static_cast<uint64_t>( node->kind ) );
+    mix( static_cast<uint64_t>( node->head ) );
+    if ( node->kind == NK::INTEGER || node->kind == NK::DECIMAL ) { // by value, as equal? compares them
+      mix( psil_parser::hash_number( node ) );
+    } else {
+      for ( auto & elem : node->aspects ) {
+	if ( elem.elem_type == TE_Type::TOKEN ) {
+	  mix( hash_tree( elem.tk.get() ) );
+	} else {
+	  mix( reinterpret_cast<uintptr_t>( elem.s ) ); // interned
+	}
+      }
+    }
+    uint32_t ret = static_cast<uint32_t>( h ^ ( h >> 32 ) );
+    if ( ret == 0 ) ret = 1; // 0 marks a hash not yet found
+    if ( node->kind == NK::CONSTANT || node->kind == NK::DATUM ) node->hash = ret;
+    return ret;
+  }
+
+  // Whether two trees have the same structure and strings
+  static bool same_tree( psil_parser::token_t * a, psil_parser::token_t * b ) {
+    if ( a == b ) return true;
+    if ( a->kind != b->kind || a->head != b->head ) return false;
+    if ( a->kind == NK::INTEGER || a->kind == NK::DECIMAL ) { // pooled literals print as written
+      return psil_parser::same_number( a, b ) && a->aspects.size() == b->aspects.size() &&
+	( a->aspects.empty() || a->aspects.front().str() == b->aspects.front().str() );
+    }
+    if ( a->aspects.size() != b->aspects.size() ) return false;
+    for ( size_t i = 0; i < a->aspects.size(); ++i ) {
+      auto & ea = a->aspects[i];
+      auto & eb = b->aspects[i];
+      if ( ea.elem_type != eb.elem_type ) return false;
+      if ( ea.elem_type == TE_Type::TOKEN ) {
+	if ( !same_tree( ea.tk.get(), eb.tk.get() ) ) return false;
+      } else if ( ea.s != eb.s ) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  // Point constant to its pooled copy, pooling it if it is new
+  void literal_pool_t::intern( psil_parser::token_ptr & constant ) {
+    if ( constant.shared() ) return; // already pooled
+    auto & bucket = buckets[ hash_tree( constant.get() ) ];
+    for ( auto & pooled : bucket ) {
+      if ( same_tree( pooled.get(), constant.get() ) ) {
+	constant = pooled.share();
+	return;
+      }
+    }
+    bucket.push_back( constant.share() );
+    ++count;
+  }
+
+  // Pool every constant in the tree
+  void pool_literals( psil_parser::token_ptr & node, literal_pool_t & pool ) {
+    if ( !node ) return;
+    if ( node->kind == NK::CONSTANT ) {
+      pool.intern( node );
+      return;
+    }
+    for ( auto & elem : node->aspects ) {
+      if ( elem.elem_type == TE_Type::TOKEN ) { pool_literals( elem.tk, pool ); }
+    }
+  }
+
+  // Address of variable in the formals of the lambdas around it, innermost last
+  static void resolve( psil_parser::token_t * node, std::vector<const psil_parser::token_t*> & formals ) {
+    switch ( node->kind ) {
+    case NK::CONSTANT:
+      return;
+    case NK::VARIABLE: {
+      //                <identifier>
+      auto & var = node->aspects.front().tk->aspects.front();
+      if ( var.elem_type != TE_Type::STRING ) return; // keywords and operators are global
+      for ( size_t d = 0; d < formals.size(); ++d ) {
+	auto args = formals[ formals.size() - 1 - d ];
+	for ( size_t i = 0; i < args->aspects.size(); ++i ) {
+	  //                <variable>       <identifier>
+	  if ( args->aspects[i].tk->aspects.front().tk->aspects.front().s == var.s ) {
+	    bool fits = d < psil_parser::FREE_SLOT && i < psil_parser::FREE_SLOT;
+	    node->depth = fits ? d : 0;
+	    node->slot = fits ? i : psil_parser::NO_SLOT; // too far, looked up by name
+	    return;
+	  }
+	}
+      }
+      node->slot = psil_parser::FREE_SLOT;
+      return;
+    }
+    case NK::LAMBDA:
+      formals.push_back( node->aspects[0].tk.get() );
+      resolve( node->aspects[1].tk.get(), formals );
+      formals.pop_back();
+      return;
+    default:
+      break;
+    }
+    for ( auto & elem : node->aspects ) {
+      if ( elem.elem_type == TE_Type::TOKEN ) { resolve( elem.tk.get(), formals ); }
+    }
+  }
+
+  // Resolve every variable in the tree
+  void resolve_node( psil_parser::token_t * node ) {
+    std::vector<const psil_parser::token_t*> formals;
+    resolve( node, formals );
+  }
+
 }
@@ -9,11 +9,15 @@
 #pragma once
 
 #include "psil_parser.h"
+#include <unordered_map>
+#include <vector>
 
 namespace psil_eval {
 
   // redeclare for ease of use
   using TE_Type = psil_parser::token_elem_t::TE_Type;
+  using NK = psil_parser::node_kind;
+  using HK = psil_parser::head_kind;
 
   /**
      Checks expressions for semantic errors
@@ -49,6 +53,67 @@ namespace psil_eval {
      @returns - bool, true if no errors found
   */
   bool check_node( psil_parser::token_t * tk );
+
+  /**
+     Lowers checked ast into its compact form
+     Parens and keywords are dropped from compound nodes, the keyword is kept as
+       the node's head, so only semantic children remain and the number of
+       children is the node's arity
+     Value tokens are tagged with their type and numbers are given their binary value
+     @param - checked token, lowered in place
+  */
+  void lower_node( psil_parser::token_t * tk );
+
+  /**
+     Finds the type of the value a <constant> or <datum> holds from its children,
+     used to tag value tokens when they are made or changed
+     @param - token to find type of
+     @return type of value, UNKNOWN if token is not a <constant> or <datum>
+  */
+  psil_parser::VarType value_type( const psil_parser::token_t * tk );
+
+  /**
+     Finds the structural hash of a token, equal trees hash the same
+     The hash is kept on <constant> and <datum> tokens once found,
+       code that changes one in place must clear its hash
+     @param - token to hash
+     @return hash, never 0
+  */
+  uint32_t hash_tree( psil_parser::token_t * tk );
+
+  /**
+     Literal Pool
+     Keeps one shared copy of each distinct constant, so equal constants
+       in the ast all point to the same token
+     Pooled constants are shared, code that changes one must own it first
+  */
+  class literal_pool_t {
+  public:
+    void intern( psil_parser::token_ptr & constant );
+    size_t size() const { return count; }
+
+  private:
+    // Constants bucketed by structural hash
+    std::unordered_map< uint32_t, std::vector<psil_parser::token_ptr> > buckets;
+    size_t count = 0;
+  };
+
+  /**
+     Replaces constants in lowered ast with their copies in the pool
+     @param - lowered token, constants below it are replaced
+     @param - pool to find or add constants in
+  */
+  void pool_literals( psil_parser::token_ptr & tk, literal_pool_t & pool );
+
+  /**
+     Gives each <variable> in lowered ast its lexical address
+     Variables bound by a lambda around them get depth, the number of lambdas
+       between them and the one binding them, and slot, the index of the argument
+       in its formals, which is the index of the argument in the frame
+     Others are given FREE_SLOT, they are only looked up in the symbol tables
+     @param - lowered token, variables below it are resolved
+  */
+  void resolve_node( psil_parser::token_t * tk );
   
 }
 
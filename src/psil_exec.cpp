@@ -7,6 +7,19 @@
 */
 
 #include "psil_exec.h"
+#include "psil_cache.h"
+#include "psil_vm.h"
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+// C includes
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace psil_exec {
 
@@ -14,34 +27,76 @@ namespace psil_exec {
   // ================== Helper functions ===============================================
   // ===================================================================================
 
-  // === Copies tk and returns an identical token tree
+  // === Copies tk and returns an identical token tree, shared subtrees are shared by the copy
   token_ptr copy_tk( const token_ptr & tk ) {
     if ( tk == nullptr ) return nullptr;
-    token_ptr tmp( new psil_parser::token_t( tk->type_name ) );
+    if ( tk.shared() ) return tk.share(); // changed only after being owned
+    token_ptr tmp( new psil_parser::token_t( tk->kind, tk->head ) );
+    tmp->vtype = tk->vtype;
+    tmp->hash = tk->hash;
+    tmp->depth = tk->depth;
+    tmp->slot = tk->slot;
+    tmp->num = tk->num;
+    tmp->aspects.reserve( tk->aspects.size() );
     for ( auto itr = tk->aspects.begin(); itr != tk->aspects.end(); ++itr ) {
-      if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	auto elem_tmp = std::make_unique<psil_parser::token_elem_t>( copy_tk( (*itr)->tk ) );
-	tmp->aspects.push_back( std::move( elem_tmp ) );
+      if ( itr->elem_type == TE_Type::TOKEN ) {
+	tmp->aspects.emplace_back( copy_tk( itr->tk ) );
       } else {
-	auto elem_tmp = std::make_unique<psil_parser::token_elem_t>( std::string( (*itr)->str ) );
-	tmp->aspects.push_back( std::move( elem_tmp ) );
+	tmp->add_str( *itr ); // interned strings are shared
       }
     }
     return tmp;
   }
+  // === Copies tk with nothing shared, variables are looked up by name in the copy
+  token_ptr copy_unresolved( const token_ptr & tk ) {
+    if ( tk == nullptr ) return nullptr;
+    if ( tk->kind == NK::CONSTANT || tk->kind == NK::FRAME ) return tk.share(); // hold no variables
+    token_ptr tmp( new psil_parser::token_t( tk->kind, tk->head ) );
+    tmp->vtype = tk->vtype;
+    tmp->hash = tk->hash;
+    tmp->num = tk->num;
+    tmp->aspects.reserve( tk->aspects.size() );
+    for ( auto itr = tk->aspects.begin(); itr != tk->aspects.end(); ++itr ) {
+      if ( itr->elem_type == TE_Type::TOKEN ) {
+	tmp->aspects.emplace_back( copy_unresolved( itr->tk ) );
+      } else {
+	tmp->add_str( *itr );
+      }
+    }
+    return tmp;
+  }
+
+  // === Whether expression is a constant or closure, which are left as they are
+  bool is_value( const token_ptr & node ) {
+    if ( node->kind != NK::EXPRESSION || node->head != HK::NONE || node->aspects.size() != 1 ||
+	 node->aspects.front().elem_type != TE_Type::TOKEN ) {
+      return false;
+    }
+    auto value = node->aspects.front().tk.get();
+    return value->kind == NK::CONSTANT || ( value->kind == NK::LAMBDA && value->vtype == VarType::PROC );
+  }
+
 
   // === Compares tk1 and tk2 structure and content for being identical
   bool equal_tk( const token_ptr & tk1, const token_ptr & tk2 ) {
-    if ( (tk1 == nullptr && tk2 != nullptr) || (tk1 != nullptr && tk2 == nullptr) ) return false;
-    if ( tk1->type_name != tk2->type_name ) return false;
+    if ( tk1.get() == tk2.get() ) return true; // shared storage
+    if ( tk1 == nullptr || tk2 == nullptr ) return false;
+    if ( tk1->kind != tk2->kind || tk1->head != tk2->head ) return false;
+    if ( ( tk1->kind == NK::CONSTANT || tk1->kind == NK::DATUM ) &&
+	 psil_eval::hash_tree( tk1.get() ) != psil_eval::hash_tree( tk2.get() ) ) {
+      return false; // values differ somewhere
+    }
+    if ( tk1->kind == NK::INTEGER || tk1->kind == NK::DECIMAL ) { // numbers are equal by value
+      return psil_parser::same_number( tk1.get(), tk2.get() );
+    }
     if ( tk1->aspects.size() != tk2->aspects.size() ) return false;
     auto itr1 = tk1->aspects.begin(); auto itr2 = tk2->aspects.begin();
     for ( ; itr1 != tk1->aspects.end() && itr2 != tk2->aspects.end(); ++itr1, ++itr2 ) {
-      if ( (*itr1)->elem_type == TE_Type::TOKEN && (*itr1)->elem_type == TE_Type::TOKEN ) {
-	bool ret = equal_tk( (*itr1)->tk, (*itr2)->tk );
+      if ( itr1->elem_type == TE_Type::TOKEN && itr1->elem_type == TE_Type::TOKEN ) {
+	bool ret = equal_tk( itr1->tk, itr2->tk );
 	if ( !ret ) return false;
-      } else if ( (*itr1)->elem_type == TE_Type::STRING && (*itr1)->elem_type == TE_Type::STRING ) {
-	if ( (*itr1)->str != (*itr2)->str ) return false;
+      } else if ( itr1->elem_type == TE_Type::STRING && itr1->elem_type == TE_Type::STRING ) {
+	if ( itr1->s != itr2->s ) return false; // interned, same string is same pointer
       } else {
 	return false;
       }
@@ -49,65 +104,27 @@ namespace psil_exec {
     return true;
   }
 
-  // === Finds token What in token Where and replaces occurence of What with That
-  bool find_replace( token_ptr & where, const token_ptr & what, token_ptr & that ) {
-    if ( where == nullptr ) { return false; }
-    bool is_expr = where->type_name == "<expression>" && where->aspects.size() == 1
-      && where->aspects.front()->elem_type == TE_Type::TOKEN;
-    if ( is_expr && equal_tk( where->aspects.front()->tk, what ) ) {
-      // Found location
-      where.reset();
-      where = std::move( copy_tk( that ) );
-      return true;
-    } else {
-      // Keep looking
-      for ( auto itr = where->aspects.begin(); itr != where->aspects.end(); ++itr ) {
-	if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	  find_replace( (*itr)->tk, what, that );
-	}
-      }
-    }
-    return false;
-  }
-
   // === Checks type of expression
   VarType check_type( const token_ptr & tk ) {
-    if ( tk->aspects.size() == 1 && tk->aspects.front()->elem_type == TE_Type::TOKEN ) {
-      if ( tk->aspects.front()->tk->type_name == "<constant>"  ) { // CONSTANT OR DATUM
-	auto const_type = tk->aspects.front()->tk.get()->aspects.front()->tk.get();
-	if ( const_type->type_name == "<boolean>" ) {
-	  return VarType::BOOL;
-	} else if ( const_type->type_name == "<number>" ) {
-	  return VarType::NUM;
-	} else if ( const_type->type_name == "<character>" ) {
-	  return VarType::CHAR;
-	} else if ( const_type->type_name == "<list_def>" ) {
-	  return check_type( const_type->aspects[2]->tk );
-	}
-	return VarType::ERROR;
-      } else if ( tk->aspects.front()->tk->type_name == "<variable>" ) { // VARIABLE
+    if ( tk->aspects.size() == 1 && tk->aspects.front().elem_type == TE_Type::TOKEN ) {
+      switch ( tk->aspects.front().tk->kind ) {
+      case NK::CONSTANT: // CONSTANT, tagged when made
+	return tk->aspects.front().tk->vtype;
+      case NK::VARIABLE: // VARIABLE
 	return VarType::SYMBOL;
-      } else if ( tk->aspects.front()->tk->type_name == "<lambda>" ) { // LAMBDA
+      case NK::LAMBDA: // LAMBDA
 	return VarType::PROC;
-      } else if ( tk->aspects.front()->tk->type_name == "<conditional>" ) { // CONDITIONAL
+      case NK::CONDITIONAL: // CONDITIONAL
 	// lazy eval, don't run
 	return VarType::UNKNOWN;
-      } else if ( tk->aspects.front()->tk->type_name == "<application>" ) { // APPLICATION
+      case NK::APPLICATION: // APPLICATION
 	// lazy eval, don't run
 	return VarType::UNKNOWN;
-      } else if ( tk->type_name == "<datum>" ) {
-	auto datum_type = tk->aspects.front()->tk->type_name;
-	if ( datum_type == "<boolean>" ) {
-	  return VarType::BOOL;
-	} else if ( datum_type == "<number>" ) {
-	  return VarType::NUM;
-	} else if ( datum_type == "<character>" ) {
-	  return VarType::CHAR;
-	} else if ( datum_type == "<symbol>" ) {
-	  return VarType::SYMBOL;
-	} else if ( datum_type == "<list>" ) {
-	  return VarType::LIST;
-	}
+      default:
+	break;
+      }
+      if ( tk->kind == NK::DATUM ) { // DATUM, tagged when made
+	return tk->vtype;
       }
     }
     return VarType::UNKNOWN;
@@ -116,25 +133,33 @@ namespace psil_exec {
 
   // === Checks an expression to see if it is a true value
   bool is_true( stack_ptr & s, token_ptr & node ) {
-    if ( node->aspects.size() == 1 && node->aspects.front()->elem_type == TE_Type::TOKEN ) {
-      if ( node->aspects.front()->tk->type_name == "<constant>" ) {
-	auto const_type = node->aspects.front()->tk.get()->aspects.front()->tk.get();
-	if ( const_type->type_name == "<boolean>" ) {
-	  return const_type->aspects.front()->str == "#t";
-	} else if ( const_type->type_name == "<number>" ) {
-	  return !is_zero( node->aspects.front()->tk.get()->aspects.front()->tk );
+    if ( node->aspects.size() == 1 && node->aspects.front().elem_type == TE_Type::TOKEN ) {
+      switch ( node->aspects.front().tk->kind ) {
+      case NK::CONSTANT: {
+	auto const_type = node->aspects.front().tk.get()->aspects.front().tk.get();
+	if ( const_type->kind == NK::BOOLEAN ) {
+	  return const_type->aspects.front().str() == "#t";
+	} else if ( const_type->kind == NK::NUMBER ) {
+	  return !is_zero( node->aspects.front().tk.get()->aspects.front().tk );
 	} else {
 	  return true;
 	}
-      } else if ( node->aspects.front()->tk->type_name == "<variable>" ) {
+      }
+      case NK::VARIABLE: {
 	//std::cerr << "Cannot look up variables yet" << std::endl;
 	bool r = false;
-	exec( s, node->aspects.front()->tk, r );
+	node.own();
+	exec( s, node->aspects.front().tk, r );
 	return is_true( s, node );
-      } else if ( node->aspects.front()->tk->type_name == "<application>" ) {
+      }
+      case NK::APPLICATION: {
 	bool r = false;
-	exec( s, node->aspects.front()->tk, r );
-	return is_true( s, node->aspects.front()->tk );
+	node.own();
+	exec( s, node->aspects.front().tk, r );
+	return is_true( s, node->aspects.front().tk );
+      }
+      default:
+	break;
       }
     }
     bool r = false; // placeholder, not needed
@@ -143,23 +168,15 @@ namespace psil_exec {
   }
 
   // === Checks a number and compares its value to 0.
-  // returns false if decimal is of form 0.00000, more accurate to use 'eq'
+  // numbers that did not fit are not 0
   bool is_zero( token_ptr & node ) {
-    if ( node->aspects.front()->tk->type_name == "<integer>" ) {
-      auto int_tk = node->aspects.front()->tk.get();
-      if ( int_tk->aspects.front()->elem_type == TE_Type::STRING &&
-	   int_tk->aspects.front()->str == "0" )
-      return true;
-      else
-	return false;
-    } else if ( node->aspects.front()->tk->type_name == "<decimal>" ) {
-      auto int_tk = node->aspects.front()->tk.get();
-      if ( int_tk->aspects.front()->elem_type == TE_Type::STRING &&
-	   int_tk->aspects.front()->str == "0.0" )
-	return true;
-      else
-	return false;
-  }
+    auto num = node->aspects.front().tk.get();
+    if ( num->vtype != VarType::NUM ) { return false; }
+    if ( num->kind == NK::INTEGER ) {
+      return num->num.i == 0;
+    } else if ( num->kind == NK::DECIMAL ) {
+      return num->num.d == 0;
+    }
     return false;
   }
   
@@ -169,6 +186,13 @@ namespace psil_exec {
   // ================ SYMBOL TABLE STACK   =============================================
   // ===================================================================================
 
+  stack_t::stack_t() : depth(0), max_depth(DEFAULT_MAX_DEPTH), stack_limit(0) {
+    init();
+  }
+
+  // Defined here, where vm_t is complete
+  stack_t::~stack_t() {}
+
   // Push to stack
   void stack_t::push() {
     table.push_back( symbol_table_t() );
@@ -182,260 +206,544 @@ namespace psil_exec {
     table.pop_back();	
   }
 
-  // Check if variable exists in symbol table
-  stack_t::ExistsType stack_t::exists( std::string n ) {
+  // Finds variable in symbol table, e is set to where it is defined
+  stack_elem_t * stack_t::find( const std::string * n, stack_t::ExistsType & e ) {
     auto gret = global_table.find( n );
-    if ( gret != global_table.end() )
-      return stack_t::ExistsType::GLOBAL;
-    auto itr = table.rbegin();
-    for ( ; itr != table.rend(); ++itr ) {
+    if ( gret != global_table.end() ) {
+      e = stack_t::ExistsType::GLOBAL;
+      return gret->second.get();
+    }
+    for ( auto itr = table.rbegin(); itr != table.rend(); ++itr ) {
       auto lret = itr->find( n );
-      if ( lret != itr->end() )
-	return stack_t::ExistsType::LOCAL;      
+      if ( lret != itr->end() ) {
+	e = stack_t::ExistsType::LOCAL;
+	return lret->second.get();
+      }
     }
-    return stack_t::ExistsType::NO;
+    e = stack_t::ExistsType::NO;
+    return nullptr;
+  }
+
+  // Check if variable exists in symbol table
+  stack_t::ExistsType stack_t::exists( const std::string * n ) {
+    stack_t::ExistsType e;
+    find( n, e );
+    return e;
   }
 
   // Gets variable from symbol table
-  token_ptr stack_t::get( std::string n, stack_t::ExistsType e ) {
-    if ( e == stack_t::ExistsType::GLOBAL ) {
-      auto itr = global_table.find( n );
-      if ( itr != global_table.end() )
-	return copy_tk( itr->second->value );
-    } else if ( e == stack_t::ExistsType::LOCAL ) {
-      auto itr = table.rbegin();
-      size_t count = 0;
-      for ( ; itr != table.rend(); ++itr, count++ ) {
-	auto ret = itr->find( n );
-	if ( ret != itr->end() ) {
-	  //std::cout << "Symbol lookup " << n << " " << table.size() - 1 - count << std::endl; 
-	  return copy_tk( ret->second->value );
-	}
-      }
-    }
-    return nullptr;
+  token_ptr stack_t::get( const std::string * n, stack_t::ExistsType e ) {
+    stack_t::ExistsType found;
+    auto elem = find( n, found );
+    if ( elem == nullptr || found != e ) return nullptr;
+    return elem->value.share();
   }
 
   // Adds variable and its value to symbol table
-  void stack_t::add( std::string n, const token_ptr & v ) {
+  void stack_t::add( const std::string * n, const token_ptr & v ) {
     if ( table.size() == 0 ) { throw std::string( "Stack empty" ); }
     VarType t = check_type( v );
     if ( t == VarType::ERROR ) throw std::string( "Could not determine type of expression" );
-    std::unique_ptr<stack_elem_t> se( new stack_elem_t( n, t, v ) );
-    size_t loc = table.size()-1;
-    //std::cout << "Inserting " << n << " " << loc << std::endl;
-    table[loc].insert( std::make_pair( n, std::move( se ) ) );
+    std::unique_ptr<stack_elem_t> se( new stack_elem_t( *n, t, v ) );
+    table.back().insert( std::make_pair( n, std::move( se ) ) );
   }
 
   // Updates variable's value in symbol table
-  void stack_t::update( std::string n, stack_t::ExistsType e, const token_ptr & v) {
-    if ( e == stack_t::ExistsType::GLOBAL ) {
-      auto itr = global_table.find( n );
-      if ( itr != global_table.end() ) {
-	itr->second->value.reset(); // delete old value
-	itr->second->value = std::move( copy_tk( v ) );
-      }
-    } else if ( e == stack_t::ExistsType::LOCAL ) {
-      auto itr = table.rbegin();
-      for ( ; itr != table.rend(); ++itr ) {
-	auto ret = itr->find( n );
-	if ( ret != itr->end() ) {
-	  ret->second->value.reset();
-	  ret->second->value = std::move( copy_tk( v ) );
-	  return;
-	}
-      }
+  void stack_t::update( const std::string * n, stack_t::ExistsType e, const token_ptr & v) {
+    stack_t::ExistsType found;
+    auto elem = find( n, found );
+    if ( elem != nullptr && found == e ) {
+      elem->value.reset(); // delete old value
+      elem->value = v.share();
     }
   }
 
+  // Global procedures are keyed by their interned name
+  static void insert_global( symbol_table_t & globals, std::unique_ptr<stack_elem_t> elem ) {
+    auto name = psil_parser::intern_str( elem->var_name );
+    globals.insert( std::make_pair( name, std::move( elem ) ) );
+  }
+
   // Initialize global procedures in symbol table
   void stack_t::init() {
     // Logical
     auto tmp = std::make_unique<stack_elem_t>( "and", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "or", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "not", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     // EQUIVALENCE
     tmp = std::make_unique<stack_elem_t>( "equal?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     // NUMBERS
     //   ARITHMETIC
     tmp = std::make_unique<stack_elem_t>( "+", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "-", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "*", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "*", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "/", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "abs", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "mod", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     //   APPROX
     tmp = std::make_unique<stack_elem_t>( "floor", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "ceil", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "trunc", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "round", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     //   INEQUALITIES
     tmp = std::make_unique<stack_elem_t>( "lt", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "lte", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "gt", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "gte", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "eq", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     //   MISC
     tmp = std::make_unique<stack_elem_t>( "zero?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     // CHARACTERS
     tmp = std::make_unique<stack_elem_t>( "ch_lt", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "ch_lte", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "ch_gt", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "ch_gte", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "ch_eq", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     // LISTS
     tmp = std::make_unique<stack_elem_t>( "length", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "first", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "second", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "nth", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "first!", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "second!", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "nth!", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "append", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "insert", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "pop", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "null?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "to_quote", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "unquote", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     // IDENTITY PREDICATES
     tmp = std::make_unique<stack_elem_t>( "boolean?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "number?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "character?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "symbol?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "proc?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "list?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "integer?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "decimal?", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     // INPUT/OUTPUT
     tmp = std::make_unique<stack_elem_t>( "print", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "println", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "read", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
     tmp = std::make_unique<stack_elem_t>( "newline", VarType::PROC, nullptr );
-    global_table.insert( std::make_pair( tmp->var_name, std::move( tmp ) ) );
+    insert_global( global_table, std::move( tmp ) );
   }
   
   // ===================================================================================
 
+  // Native stack used by exec for each nested lambda call, and for everything else
+  // Measured at -O3 a call takes about 400 bytes, and each application nested in its body about 380
+  //  more, 550 and 530 in a debug build, tests/depth_limit runs three nested in each call up to
+  //  the limit. Bodies nesting more applications run out of stack before max_depth, with the same error,
+  //  README and docs/EXEC state this limit
+  static const size_t STACK_PER_DEPTH = 2048;
+  static const size_t STACK_BASE = 8 << 20;
+  // Room left below the limit of exec, for global procedures and errors
+  static const size_t STACK_MARGIN = 1 << 20;
+  // Top of the stack kept between runs, the pages below are given back once a run is done
+  static const size_t STACK_KEPT = 1 << 20;
+
+  // Thread owning the stack, made once and given each run, so repl lines do not map a new stack
+  struct stack_runner_t {
+    size_t max_depth;
+    size_t page;
+    size_t size; // bytes of stack, above the guard page
+    void * map; // guard page then stack
+    pthread_t thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    const std::function<void(uintptr_t)> * fn; // run given to thread, nullptr when idle
+    std::exception_ptr err;
+    bool quit;
+  };
+
+  // === Give back pages of the stack below the top STACK_KEPT bytes of it, they are zero if used again
+  static void release_stack( stack_runner_t * run, uintptr_t top ) {
+    uintptr_t low = reinterpret_cast<uintptr_t>( run->map ) + run->page;
+    if ( top - low > STACK_KEPT ) {
+      uintptr_t high = ( top - STACK_KEPT ) / run->page * run->page;
+      madvise( reinterpret_cast<void*>( low ), high - low, MADV_DONTNEED );
+    }
+  }
+
+  static void * runner_entry( void * arg ) {
+    auto run = static_cast<stack_runner_t*>( arg );
+    char base; // top of the stack of this thread
+    uintptr_t top = reinterpret_cast<uintptr_t>( &base );
+    uintptr_t limit = top - run->size + STACK_MARGIN;
+    std::unique_lock<std::mutex> hold( run->lock );
+    while ( true ) {
+      run->wake.wait( hold, [run]{ return run->fn != nullptr || run->quit; } );
+      if ( run->quit ) { return nullptr; }
+      hold.unlock();
+      try {
+	( *run->fn )( limit );
+      } catch ( ... ) {
+	run->err = std::current_exception();
+      }
+      release_stack( run, top );
+      hold.lock();
+      run->fn = nullptr;
+      run->wake.notify_all();
+    }
+  }
+
+  // === Map a stack large enough for max_depth nested calls of exec and start a thread on it
+  // Pages of the stack take memory once used, nullptr if the stack or thread cannot be made
+  static stack_runner_t * make_runner( size_t max_depth ) {
+    auto run = new stack_runner_t;
+    run->max_depth = max_depth;
+    run->page = sysconf( _SC_PAGESIZE );
+    run->size = STACK_BASE;
+    run->fn = nullptr;
+    run->quit = false;
+    if ( max_depth < ( SIZE_MAX / 4 - STACK_BASE ) / STACK_PER_DEPTH ) {
+      run->size += max_depth * STACK_PER_DEPTH;
+    } else {
+      run->size = SIZE_MAX / 4;
+    }
+    run->size = ( run->size + run->page - 1 ) / run->page * run->page;
+    // Lowest page is left unmapped, so running past the end faults instead of writing over memory
+    run->map = mmap( nullptr, run->size + run->page, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0 );
+    if ( run->map == MAP_FAILED ) {
+      delete run;
+      return nullptr;
+    }
+    mprotect( run->map, run->page, PROT_NONE );
+    pthread_attr_t attr;
+    pthread_attr_init( &attr );
+    bool made = pthread_attr_setstack( &attr, static_cast<char*>( run->map ) + run->page, run->size ) == 0 &&
+      pthread_create( &run->thread, &attr, runner_entry, run ) == 0;
+    pthread_attr_destroy( &attr );
+    if ( !made ) {
+      munmap( run->map, run->size + run->page );
+      delete run;
+      return nullptr;
+    }
+    return run;
+  }
+
+  // === Stop thread of run and unmap its stack
+  static void stop_runner( stack_runner_t * run ) {
+    {
+      std::lock_guard<std::mutex> hold( run->lock );
+      run->quit = true;
+    }
+    run->wake.notify_all();
+    pthread_join( run->thread, nullptr );
+    munmap( run->map, run->size + run->page );
+    delete run;
+  }
+
+  // === Run fn on a native stack large enough for max_depth nested calls of exec
+  // fn is given the lowest address exec may use, the stack is kept for the next run with the same max_depth
+  static void run_on_stack( size_t max_depth, const std::function<void(uintptr_t)> & fn ) {
+    static stack_runner_t * runner = nullptr; // never freed, its thread waits for the next run
+    if ( runner != nullptr && runner->max_depth != max_depth ) {
+      stop_runner( runner );
+      runner = nullptr;
+    }
+    if ( runner == nullptr ) {
+      runner = make_runner( max_depth );
+      if ( runner == nullptr ) {
+	std::cerr << "Could not make a stack for max depth " << max_depth << std::endl;
+	return;
+      }
+    }
+    std::exception_ptr err;
+    {
+      std::unique_lock<std::mutex> hold( runner->lock );
+      runner->fn = &fn;
+      runner->wake.notify_all();
+      runner->wake.wait( hold, []{ return runner->fn == nullptr; } );
+      std::swap( err, runner->err );
+    }
+    if ( err ) { std::rethrow_exception( err ); }
+  }
+
+  // === Stack for running code, with the vm when use_vm is set
+  static stack_ptr make_stack( bool use_vm, size_t max_depth, uintptr_t limit ) {
+    auto stack = std::make_unique<stack_t>();
+    if ( use_vm ) stack->vm = std::make_unique<psil_vm::vm_t>();
+    stack->max_depth = max_depth;
+    stack->stack_limit = limit;
+    stack->push();
+    return stack;
+  }
+
   // === Run, Evaluate, Print, ...
-  void repl( const std::unique_ptr<psil_parser::language_t> & lang, std::string input ) {
-    
+  void repl( const std::unique_ptr<psil_parser::language_t> & lang, std::string input, bool use_vm,
+	     size_t max_depth ) {
+    run_on_stack( max_depth, [&]( uintptr_t limit ) {
+			       psil_parser::arena_t arena; // tokens of this evaluation
+			       auto stack = make_stack( use_vm, max_depth, limit );
+			       run_input( lang, stack, input );
+			       arena.drop(); // values left on stack are released with the arena
+			     } );
+  }
+
+  // === Parse, verify and execute input against stack
+  bool run_input( const std::unique_ptr<psil_parser::language_t> & lang,
+		  stack_ptr & stack, const std::string & input ) {
+    bool checked = false;
+    auto ast = read_input( lang, input, checked );
+    return ast && exec_input( stack, ast );
+  }
+
+  // === Parse, verify and lower input
+  token_ptr read_input( const std::unique_ptr<psil_parser::language_t> & lang,
+			const std::string & input, bool & checked ) {
     auto ast = psil_parser::parse( lang, input );
     if ( ast ) {
       // eval
       try {
-	if ( !psil_eval::check_node( ast.get() ) )
+	checked = psil_eval::check_node( ast.get() );
+	if ( !checked )
 	  std::cerr << "Unknown Error while verifying code!" << std::endl;
+	psil_eval::lower_node( ast.get() );
       } catch ( std::string exp ) {
 	std::cerr << "Error while verifying code:: " << exp << std::endl;
-	return;
+	return nullptr;
       }
-      
-      // exec
-      try {
-	bool rem = false;
-	auto stack = std::make_unique<stack_t>();
-	exec( stack, ast, rem );
-      } catch ( std::string exp ) {
-	std::cerr << "Runtime error:: " << exp << std::endl;
-      }
-      
     } else {
       std::cerr << "Error while parsing input" << std::endl;
     }
+    return ast;
+  }
+
+  // === Execute verified input against stack
+  bool exec_input( stack_ptr & stack, token_ptr & ast ) {
+    psil_eval::resolve_node( ast.get() ); // addresses are not cached, forms from the cache get them here
+    psil_eval::pool_literals( ast, stack->literals );
+    size_t scopes = stack->table.size(); // scopes of begins the error leaves are popped back to it
+    try {
+      bool rem = false;
+      if ( stack->vm ) {
+	stack->vm->run( stack, ast, rem );
+      } else {
+	exec( stack, ast, rem );
+      }
+    } catch ( std::string exp ) {
+      std::cerr << "Runtime error:: " << exp << std::endl;
+      stack->env.reset(); // error left the lambda it was raised in
+      stack->depth = 0;
+      while ( stack->table.size() > scopes ) { stack->pop(); }
+      return false;
+    }
+    return true;
+  }
+
+  // ===================================================================================
+
+  // Map file into memory, read it through a stream if it cannot be mapped
+  form_reader_t::form_reader_t( const std::string & filename ) :
+    data(nullptr), size(0), pos(0), stream() {
+    int fd = open( filename.c_str(), O_RDONLY );
+    if ( fd >= 0 ) {
+      struct stat st;
+      if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+	void * m = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( m != MAP_FAILED ) {
+	  madvise( m, st.st_size, MADV_SEQUENTIAL );
+	  data = static_cast<const char*>( m );
+	  size = st.st_size;
+	}
+      }
+      close( fd );
+    }
+    if ( data == nullptr ) { stream.open( filename ); }
   }
 
-  // === Execute code in file given by filename
-  void run_file( const std::unique_ptr<psil_parser::language_t> & lang, std::string filename ) {
+  form_reader_t::~form_reader_t() {
+    if ( data != nullptr ) { munmap( const_cast<char*>( data ), size ); }
+  }
+
+  // Whether file could be opened
+  bool form_reader_t::good() const {
+    return data != nullptr || stream.good();
+  }
+
+  // Contents of file if it is mapped, empty otherwise
+  std::string_view form_reader_t::contents() const {
+    return ( data != nullptr ) ? std::string_view( data, size ) : std::string_view();
+  }
+
+  // Next character of file, EOF at end
+  int form_reader_t::get() {
+    if ( data != nullptr ) {
+      return ( pos < size ) ? static_cast<unsigned char>( data[pos++] ) : EOF;
+    }
+    return stream.get();
+  }
+
+  // === Read the next top level form, whitespace is collapsed to single spaces
+  bool form_reader_t::next( std::string & form ) {
+    form.clear();
+    int depth = 0;
+    int c = get();
+    while ( c != EOF && std::isspace( c ) ) { c = get(); }
+    if ( c == EOF ) { return false; }
+    for ( ; c != EOF; c = get() ) {
+      if ( std::isspace( c ) ) {
+	if ( depth == 0 ) { break; } // end of top level atom
+	if ( form.back() != ' ' ) { form += ' '; }
+	continue;
+      }
+      form += static_cast<char>( c );
+      if ( c == '(' || c == '[' ) {
+	++depth;
+      } else if ( c == ')' || c == ']' ) {
+	if ( --depth <= 0 ) { break; } // form closed, or stray paren for parser to report
+      }
+    }
+    return true;
+  }
+
+  // === Execute code in file given by filename, one top level form at a time
+  void run_file( const std::unique_ptr<psil_parser::language_t> & lang, std::string filename,
+		 bool use_vm, size_t max_depth ) {
     // === Open file ===
-    std::ifstream code( filename );
+    form_reader_t code( filename );
     if ( !code.good() ) {
       std::cerr << "Could not open file: " << filename << std::endl;
       return;
     }
-    // === Combine into string ===
-    std::string input, tmp;
-    while ( code >> tmp ) { input += tmp + " "; }
-    // === Run code ===
-    repl( lang, input );
+    run_on_stack( max_depth, [&]( uintptr_t limit ) {
+			       psil_parser::arena_t arena; // tokens of this run
+			       auto stack = make_stack( use_vm, max_depth, limit );
+			       run_forms( lang, stack, code, filename );
+			       arena.drop(); // values left on stack are released with the arena
+			     } );
+  }
+
+  // === Run forms of file against stack, from its cache when it is valid
+  void run_forms( const std::unique_ptr<psil_parser::language_t> & lang, stack_ptr & stack,
+		  form_reader_t & code, const std::string & filename ) {
+    std::string form;
+    if ( !code.next( form ) ) { // let parser report empty file
+      run_input( lang, stack, form );
+      return;
+    }
+
+    // === Run checked forms from cache if source is unchanged ===
+    std::unique_ptr<psil_cache::cache_writer_t> cache;
+    std::string_view src = code.contents();
+    if ( !src.empty() ) {
+      std::string path = psil_cache::cache_path( filename );
+      uint64_t hash = psil_cache::hash_source( src );
+      psil_cache::cache_reader_t cached( path, hash, src.size() );
+      if ( cached.good() ) {
+	while ( auto ast = cached.next() ) {
+	  if ( !exec_input( stack, ast ) ) { break; }
+	}
+	return;
+      }
+      cache = std::make_unique<psil_cache::cache_writer_t>( path, hash, src.size() );
+    }
+
+    // === Run each form in the same scope, caching it before exec rewrites it ===
+    bool ok = true;
+    do {
+      bool checked = false;
+      auto ast = read_input( lang, form, checked );
+      if ( !ast ) { ok = false; break; }
+      if ( cache && checked ) {
+	cache->add( ast.get() );
+      } else {
+	cache.reset();
+      }
+      if ( !exec_input( stack, ast ) ) { ok = false; break; }
+    } while ( code.next( form ) );
+    if ( ok && cache ) { cache->finish(); }
   }
+
   
   // ===================================================================================
   
-  // === Execute abstract syntax tree
-  void exec( stack_ptr & s, token_ptr & ast, bool& rem ) {
-    if ( ast == nullptr ) { return; }
-    if ( ast->type_name == "<program>" ) {
-      // Push to stack
-      s->push();
-      if ( !ast->aspects.empty() && ast->aspects.front()->elem_type == TE_Type::TOKEN ) {
-	exec( s, ast->aspects.front()->tk, rem );
+  // === Run ast once, returns true if ast was replaced by code that still has to run
+  static bool exec_step( stack_ptr & s, token_ptr & ast, bool& rem, size_t & scopes ) {
+    if ( ast == nullptr ) { return false; }
+    if ( ast->kind == NK::EXPRESSION && ast->head != HK::BEGIN && ast->aspects.size() == 1 ) {
+      auto k = ast->aspects.front().tk->kind;
+      if ( k == NK::CONSTANT ) { return false; } // values are left as they are
+      if ( k == NK::LAMBDA ) { // lambdas close over the frame they are reached in
+	if ( ast->aspects.front().tk->vtype != VarType::PROC ) { make_closure( s, ast ); }
+	return false;
+      }
+    }
+    ast.own(); // may be shared with a value on the stack
+    switch ( ast->kind ) {
+    case NK::PROGRAM:
+      // Scope of program is pushed by caller, so it can outlive the program
+      if ( !ast->aspects.empty() && ast->aspects.front().elem_type == TE_Type::TOKEN ) {
+	exec( s, ast->aspects.front().tk, rem );
 	// all forms erased, erase program
 	if ( rem ) ast->aspects.clear();
       }
-      // Pop from stack
-      s->pop();
-      return;
-    } else if ( ast->type_name == "<form>" ) {
+      return false;
+    case NK::FORM: {
       // Push to stack
-      bool do_push = ast->aspects.size() > 1;
+      bool do_push = ast->head == HK::BEGIN;
       if ( do_push ) s->push();
       size_t tk_count = 0, rm_count = 0;
       for ( auto itr = ast->aspects.begin(); itr != ast->aspects.end();  ) {
-	if ( (*itr)->elem_type == TE_Type::TOKEN ) {
+	if ( itr->elem_type == TE_Type::TOKEN ) {
 	  ++tk_count;
 	  bool r = false;
-	  exec( s, (*itr)->tk, r );
+	  exec( s, itr->tk, r );
 	  if ( r ) { // erase aspect
 	    ++rm_count;
 	    itr = ast->aspects.erase( itr );
@@ -447,43 +755,67 @@ namespace psil_exec {
       // all tokens erased, erase current token
       if ( tk_count == rm_count )
 	rem = true;
-      else if ( ast->aspects.size() == 4 && tk_count > rm_count && tk_count - rm_count == 1 ) {
-	auto tmp = std::move( ast->aspects[2] );
-	ast->type_name = tmp->tk->type_name;
+      else if ( do_push && tk_count > rm_count && tk_count - rm_count == 1 ) {
+	auto tmp = std::move( ast->aspects.front() );
+	tmp.tk.own();
+	ast->kind = tmp.tk->kind;
+	ast->head = tmp.tk->head;
+	ast->vtype = tmp.tk->vtype;
+	ast->hash = tmp.tk->hash;
+	ast->num = tmp.tk->num;
 	ast->aspects.clear();
-	std::move( tmp->tk->aspects.begin(), tmp->tk->aspects.end(), std::back_inserter( ast->aspects ) );
+	std::move( tmp.tk->aspects.begin(), tmp.tk->aspects.end(), std::back_inserter( ast->aspects ) );
       }
       // Pop stack
       if ( do_push ) s->pop();
-      return;
-    } else if ( ast->type_name == "<expression>" ) {
-      auto expr = ast->aspects.front()->tk.get();
-      if ( ast->aspects.size() == 1 ) {
-	if ( expr->type_name == "<constant>" ) {
-	  return;
-	} else if ( expr->type_name == "<variable>" ) {
+      return false;
+    }
+    case NK::EXPRESSION: {
+      auto expr = ast->aspects.front().tk.get();
+      if ( ast->head != HK::BEGIN && ast->aspects.size() == 1 ) {
+	switch ( expr->kind ) {
+	case NK::CONSTANT:
+	  return false;
+	case NK::VARIABLE: {
 	  bool g = exec_var( s, ast, rem );
-	  if ( g ) return;
-	} else if ( expr->type_name == "<lambda>" ) {
-	  return;
-	} else if ( expr->type_name == "<conditional>" ) {
-	  if ( expr->aspects[1]->str == "cond" ) { // COND
+	  if ( g ) return false;
+	  break;
+	}
+	case NK::LAMBDA:
+	  return false;
+	case NK::CONDITIONAL:
+	  if ( expr->head == HK::COND ) { // COND
 	    exec_cond( s, ast, rem );
 	  } else { // IF
 	    exec_if( s, ast, rem );
 	  }
-	} else if ( expr->type_name == "<application>" ) {
+	  break;
+	case NK::APPLICATION:
 	  exec_app( s, ast, rem );
+	  break;
+	default:
+	  break;
 	}
-      } else if ( ast->aspects.size() >= 4 ) { // (begin <expr>+)
+      } else if ( ast->head == HK::BEGIN ) { // (begin <expr>+)
 	// Push to stack
 	s->push();
 	size_t tk_count = 0, rm_count = 0;
 	for ( auto itr = ast->aspects.begin(); itr != ast->aspects.end(); ) {
-	  if ( (*itr)->elem_type == TE_Type::TOKEN ) {
+	  if ( itr->elem_type == TE_Type::TOKEN ) {
 	    ++tk_count;
+	    if ( tk_count - 1 == rm_count && std::next( itr ) == ast->aspects.end() ) {
+	      // Last expression is all that is left, it runs in place of begin as a tail call
+	      if ( s->table.back().empty() ) {
+		s->pop();
+	      } else { // definitions stay visible until it is done
+		++scopes;
+	      }
+	      auto last = std::move( itr->tk );
+	      ast = std::move( last );
+	      return true;
+	    }
 	    bool r = false;
-	    exec( s, (*itr)->tk, r );
+	    exec( s, itr->tk, r );
 	    if ( r ) {
 	      ++rm_count;
 	      itr = ast->aspects.erase( itr );
@@ -495,40 +827,76 @@ namespace psil_exec {
 	if ( tk_count == rm_count ) {
 	  rem = true;
 	} else if ( tk_count > rm_count && tk_count - rm_count == 1 ) {
-	  auto tmp = std::move( ast->aspects[2] );
-	  ast->type_name = tmp->tk->type_name;
+	  auto tmp = std::move( ast->aspects.front() );
+	  tmp.tk.own();
+	  ast->kind = tmp.tk->kind;
+	  ast->head = tmp.tk->head;
+	  ast->vtype = tmp.tk->vtype;
+	  ast->hash = tmp.tk->hash;
+	  ast->num = tmp.tk->num;
 	  ast->aspects.clear();
-	  std::move( tmp->tk->aspects.begin(), tmp->tk->aspects.end(), std::back_inserter( ast->aspects ) );
+	  std::move( tmp.tk->aspects.begin(), tmp.tk->aspects.end(), std::back_inserter( ast->aspects ) );
 	}
 	// Pop stack
 	s->pop();
-	return;
+	return false;
       } else {
 	ast->print();
 	throw std::string( "Unknown expression type" );
-      }	
-    } else if ( ast->type_name == "<definition>" ) {
+      }
+      break;
+    }
+    case NK::DEFINITION:
       rem = true; // always erase definitions from AST
       exec_def( s, ast );
-      return;
+      return false;
+    default:
+      break;
     }
-    if ( rem ) return;
-    exec( s, ast, rem );
+    return !rem; // ast was replaced, run it again
+  }
+
+
+  // === Execute abstract syntax tree
+  // Applied lambdas, if branches and last expressions of begin replace ast and run in this loop,
+  //  so calls in tail position do not nest, the frame of the caller is restored when done
+  void exec( stack_ptr & s, token_ptr & ast, bool& rem ) {
+    if ( ast != nullptr && ast->kind == NK::EXPRESSION && ast->head != HK::BEGIN &&
+	 ast->aspects.size() == 1 && ast->aspects.front().tk->kind == NK::CONSTANT ) {
+      return; // values are left as they are
+    }
+    char here; // deepest frames of exec are checked against the end of the native stack
+    if ( reinterpret_cast<uintptr_t>( &here ) < s->stack_limit ) {
+      throw std::string( "Stack depth exceeded" );
+    }
+    auto env = s->env.share();
+    size_t scopes = 0; // scopes of begins whose last expression ran in their place
+    bool called = false; // whether a lambda is applied in this call, tail calls replace it
+    while ( exec_step( s, ast, rem, scopes ) ) {
+      if ( !called && s->env.get() != env.get() ) {
+	called = true;
+	if ( ++s->depth > s->max_depth ) { throw std::string( "Stack depth exceeded" ); }
+      }
+    }
+    for ( ; scopes > 0; --scopes ) { s->pop(); }
+    if ( s->env.get() != env.get() ) { s->env = std::move( env ); }
+    if ( called ) { --s->depth; }
   }
 
   // =================================================================================================
   
   // === Execute if expression
   void exec_if( stack_ptr & s, token_ptr & node, bool& rem ) {
-    auto cond = node->aspects.front()->tk.get();
+    node->aspects.front().tk.own();
+    auto cond = node->aspects.front().tk.get();
     bool r = false;
-    exec( s, cond->aspects[2]->tk, r );
-    if ( r || is_true( s, cond->aspects[2]->tk ) ) {
-      auto tmp_ans = std::move( cond->aspects[3]->tk );
+    exec( s, cond->aspects[0].tk, r );
+    if ( r || is_true( s, cond->aspects[0].tk ) ) {
+      auto tmp_ans = std::move( cond->aspects[1].tk );
       node.reset();
       node = std::move( tmp_ans );
     } else {
-      auto tmp_ans = std::move( cond->aspects[4]->tk );
+      auto tmp_ans = std::move( cond->aspects[2].tk );
       node.reset();
       node = std::move( tmp_ans );
     }
@@ -536,11 +904,12 @@ namespace psil_exec {
   
   // === Execute cond expression
   void exec_cond( stack_ptr & s, token_ptr & node, bool& rem ) {
-    auto cond = node->aspects.front()->tk.get();
+    node->aspects.front().tk.own();
+    auto cond = node->aspects.front().tk.get();
     bool r = false; // placeholder, not needed
-    exec( s, cond->aspects[2]->tk, r );
-    if ( r || is_true( s, cond->aspects[2]->tk ) ) {
-      auto tmp_ans = std::move( cond->aspects[3]->tk );
+    exec( s, cond->aspects[0].tk, r );
+    if ( r || is_true( s, cond->aspects[0].tk ) ) {
+      auto tmp_ans = std::move( cond->aspects[1].tk );
       node.reset();
       node = std::move( tmp_ans );
     } else {
@@ -551,31 +920,31 @@ namespace psil_exec {
 
   // === Execute definition
   void exec_def( stack_ptr & s, token_ptr & node ) {
-    if ( node->aspects[1]->str == "define" ) {
-      auto iden = node->aspects[2]->tk->aspects.front()->tk->aspects.front()->str;
+    if ( node->head == HK::DEFINE ) {
+      auto iden = node->aspects[0].tk->aspects.front().tk->aspects.front().s;
       auto ret = s->exists( iden );
       if ( ret == stack_t::ExistsType::GLOBAL ) {
-	throw std::string( "Cannot redefine a global procedure "+iden );
+	throw std::string( "Cannot redefine a global procedure "+*iden );
       } else if ( ret == stack_t::ExistsType::LOCAL ) {
-	throw std::string( "Cannot redefine a local variable, use update "+iden );
+	throw std::string( "Cannot redefine a local variable, use update "+*iden );
       } else { // NO - variable is not known
 	bool r = false;
-	exec( s, node->aspects[3]->tk, r);
-	if ( r ) throw std::string( "Update error "+iden );
-	s->add( iden, node->aspects[3]->tk );
+	exec( s, node->aspects[1].tk, r);
+	if ( r ) throw std::string( "Update error "+*iden );
+	s->add( iden, node->aspects[1].tk );
       }
-    } else if ( node->aspects[1]->str == "update" ) {
-      auto iden = node->aspects[2]->tk->aspects.front()->tk->aspects.front()->str;
+    } else if ( node->head == HK::UPDATE ) {
+      auto iden = node->aspects[0].tk->aspects.front().tk->aspects.front().s;
       auto ret = s->exists( iden );
       if ( ret == stack_t::ExistsType::GLOBAL ) {
-	throw std::string( "Cannot update a global procedure "+iden );
+	throw std::string( "Cannot update a global procedure "+*iden );
       } else if ( ret == stack_t::ExistsType::LOCAL ) {
 	bool r = false;
-	exec( s, node->aspects[3]->tk, r);
-	if ( r ) throw std::string( "Update error "+iden );
-	s->update( iden, ret, node->aspects[3]->tk );
+	exec( s, node->aspects[1].tk, r);
+	if ( r ) throw std::string( "Update error "+*iden );
+	s->update( iden, ret, node->aspects[1].tk );
       } else { // NO - variable is not known
-	throw std::string( "Cannot set a variable that has not been defined "+iden );
+	throw std::string( "Cannot set a variable that has not been defined "+*iden );
       }
     } else {
       node->print();
@@ -585,51 +954,95 @@ namespace psil_exec {
 
   // === Execute variable expansion
   bool exec_var( stack_ptr & s, token_ptr & node, bool& rem ) {
-    auto var = node->aspects.front()->tk->aspects.front()->tk->aspects.front().get();
-    std::string var_name;
-    if ( var->elem_type == TE_Type::TOKEN )
-      var_name = var->tk->aspects.front()->str;
-    else
-      var_name = var->str;
-    // Lookup varible name
-    auto ret = s->exists( var_name );
-    if ( ret == stack_t::ExistsType::GLOBAL ) {
-      // Leave it alone
-      return true;
-    } else if ( ret == stack_t::ExistsType::LOCAL ) {
-      auto value = s->get( var_name, ret );
-      node.reset(); // erase current token
-      node = std::move( value ); // replace with value
-    } else { // NO - variable is not known
-      throw std::string( "Variable does not exist: "+var_name );
+    auto variable = node->aspects.front().tk.get();
+    auto var = &variable->aspects.front().tk->aspects.front();
+    const token_ptr * value = nullptr;
+    if ( var->elem_type == TE_Type::STRING ) { // arguments of running lambda come first
+      if ( variable->slot == psil_parser::NO_SLOT ) {
+	value = find_arg( s->env.get(), var->s );
+      } else if ( variable->slot != psil_parser::FREE_SLOT ) {
+	value = find_arg( s->env.get(), variable->depth, variable->slot, var->s );
+      }
     }
+    if ( value == nullptr ) {
+      // Lookup varible name
+      auto name = var->elem_type == TE_Type::TOKEN ? var->tk->aspects.front().s : var->s;
+      stack_t::ExistsType ret;
+      auto elem = s->find( name, ret );
+      if ( ret == stack_t::ExistsType::GLOBAL ) {
+	// Leave it alone
+	return true;
+      } else if ( ret == stack_t::ExistsType::NO ) { // variable is not known
+	throw std::string( "Variable does not exist: "+*name );
+      }
+      value = &elem->value;
+    }
+    // Code passed as written runs here, not where its addresses were given
+    node = is_value( *value ) ? value->share() : copy_unresolved( *value );
     return false;
   }
 
+  // === Find argument at its lexical address, the frame there binds it when code runs where written
+  const token_ptr * find_arg( const psil_parser::token_t * frame, size_t depth, size_t slot,
+			      const std::string * name ) {
+    auto f = frame;
+    for ( ; f != nullptr && depth > 0; --depth ) {
+      f = ( f->aspects.size() & 1 ) ? f->aspects.back().tk.get() : nullptr;
+    }
+    if ( f != nullptr && 2 * slot + 1 < f->aspects.size() && f->aspects[2 * slot].s == name ) {
+      return &f->aspects[2 * slot + 1].tk;
+    }
+    return find_arg( frame, name );
+  }
+
+  // === Find argument in frame, then in the frames of the lambdas it was made in
+  const token_ptr * find_arg( const psil_parser::token_t * frame, const std::string * name ) {
+    while ( frame != nullptr ) {
+      size_t n = frame->aspects.size() & ~size_t(1); // name value pairs, then enclosing frame
+      for ( size_t i = 0; i < n; i += 2 ) {
+	if ( frame->aspects[i].s == name ) { // interned, same name is same pointer
+	  return &frame->aspects[i+1].tk;
+	}
+      }
+      frame = n < frame->aspects.size() ? frame->aspects.back().tk.get() : nullptr;
+    }
+    return nullptr;
+  }
+
+  // === Turn lambda expression into closure over running frame
+  void make_closure( stack_ptr & s, token_ptr & node ) {
+    node.own();
+    auto & lambda = node->aspects.front().tk;
+    lambda.own();
+    lambda->vtype = VarType::PROC;
+    if ( s->env != nullptr ) { lambda->aspects.emplace_back( s->env.share() ); }
+  }
+
   // === Execute application of procedures
   void exec_app( stack_ptr & s, token_ptr & node, bool & rem ) {
+    node->aspects.front().tk.own(); // arguments are replaced in place
     bool exec_args = true; // Whether to execute arguments
     size_t idx = 0; // Keeps track of location within expression
     std::string func_name; // Used to lookup proper global procedures
     stack_t::ExistsType func_loc = stack_t::ExistsType::NO; // Says whether function is lambda or builtin
     // === Perform checks and get info about application ===
-    auto itr = node->aspects.front()->tk->aspects.begin();
-    for ( ; itr != node->aspects.front()->tk->aspects.end(); ++itr, ++idx ) {
-      if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	if ( idx == 1 ) { // Function name
-	  if ( (*itr)->tk->aspects.size() == 1 &&
-	       (*itr)->tk->aspects.front()->elem_type == TE_Type::TOKEN ) {
-	    auto exp_tmp = (*itr)->tk->aspects.front()->tk.get();
-	    auto exp_type = exp_tmp->type_name;
-	    if ( exp_type == "<variable>" ) {
+    auto itr = node->aspects.front().tk->aspects.begin();
+    for ( ; itr != node->aspects.front().tk->aspects.end(); ++itr, ++idx ) {
+      if ( itr->elem_type == TE_Type::TOKEN ) {
+	if ( idx == 0 ) { // Function name
+	  if ( itr->tk->head == HK::NONE && itr->tk->aspects.size() == 1 &&
+	       itr->tk->aspects.front().elem_type == TE_Type::TOKEN ) {
+	    auto exp_tmp = itr->tk->aspects.front().tk.get();
+	    auto exp_type = exp_tmp->kind;
+	    if ( exp_type == NK::VARIABLE ) {
 	      //         <variable>              <identifier>
-	      auto iden = exp_tmp->aspects.front()->tk.get();
-	      if ( iden->aspects.front()->elem_type == TE_Type::TOKEN ) { // Keyword or Operator
-		func_name = iden->aspects.front()->tk->aspects.front()->str;
-		if ( iden->aspects.front()->tk->type_name == "<operator>" ) {
+	      auto iden = exp_tmp->aspects.front().tk.get();
+	      if ( iden->aspects.front().elem_type == TE_Type::TOKEN ) { // Keyword or Operator
+		func_name = iden->aspects.front().tk->aspects.front().str();
+		if ( iden->aspects.front().tk->kind == NK::OPERATOR ) {
 		  func_loc = stack_t::ExistsType::GLOBAL;
 		} else {
-		  func_loc = s->exists( func_name );
+		  func_loc = s->exists( iden->aspects.front().tk->aspects.front().s );
 		  if ( func_loc != stack_t::ExistsType::GLOBAL ) {
 		    throw std::string( "Could not find proc" );
 		  }
@@ -637,7 +1050,7 @@ namespace psil_exec {
 		}
 	      } else { // Locally defined operation
 		bool r = false;
-		exec_var( s, (*itr)->tk, r );
+		exec_var( s, itr->tk, r );
 		if ( r )
 		  throw std::string( "Missing function in application expression" );
 		//throw std::string( "Error in application: Not a procedure, identifier found" );
@@ -645,13 +1058,13 @@ namespace psil_exec {
 		exec_app( s, node, rem );
 		return;
 	      }
-	    } else if ( exp_type == "<lambda>" ) {
+	    } else if ( exp_type == NK::LAMBDA ) {
 	      func_loc = stack_t::ExistsType::LOCAL;
-	    } else if ( exp_type == "<constant>" ) {
+	    } else if ( exp_type == NK::CONSTANT ) {
 	      throw std::string( "Cannot apply a constant" );
 	    } else {
 	      bool r = false;
-	      exec( s, (*itr)->tk, r );
+	      exec( s, itr->tk, r );
 	      if ( r )
 		throw std::string( "Missing function in application expression" );
 	      else {
@@ -662,19 +1075,22 @@ namespace psil_exec {
 	    }
 	  } else {
 	    bool r = false;
-	    exec( s, (*itr)->tk, r );
+	    exec( s, itr->tk, r );
 	    if ( r )
 	      throw std::string( "Missing function in application expression" );
 	    else {
-	      exec_app( s, node->aspects.front()->tk, rem );
+	      exec_app( s, node->aspects.front().tk, rem );
 	      return;
 	    }
 	  }
-	} else if ( idx > 1 && idx < (node->aspects.front()->tk->aspects.size()-1) ) { // Arguments
-	  if ( exec_args ) {
-	    bool r = false;
-	    exec( s, (*itr)->tk, r );
-	    if ( r ) node->aspects.front()->tk->aspects.erase( itr );
+	} else if ( !exec_args ) { // Code given to to_quote
+	  write_frame( s, itr->tk );
+	} else { // Arguments
+	  bool r = false;
+	  exec( s, itr->tk, r );
+	  if ( r ) {
+	    itr = node->aspects.front().tk->aspects.erase( itr );
+	    if ( itr == node->aspects.front().tk->aspects.end() ) { break; }
 	  }
 	}
       }
@@ -693,45 +1109,44 @@ namespace psil_exec {
   void apply_lambda( stack_ptr & s, token_ptr & node, bool& rem ) {
     // === Check for issues ===
     //       <expression>           <application>
-    auto app = node->aspects.front()->tk.get();
+    auto app = node->aspects.front().tk.get();
     //           <application>     <expression>        <lambda>
-    auto lambda = app->aspects[1]->tk->aspects.front()->tk.get();
+    auto lambda = app->aspects.front().tk->aspects.front().tk.get();
 
-    size_t lambda_args = lambda->aspects[2]->tk->aspects.size() - 2;
-    size_t app_args = app->aspects.size() - 3;
+    size_t lambda_args = lambda->aspects[0].tk->aspects.size();
+    size_t app_args = app->aspects.size() - 1;
     if ( lambda_args != app_args ) { // Arity Error
       std::string err = "Arity mismatch, expected:" + std::to_string( lambda_args );
       err += " given:" + std::to_string( app_args );
       throw std::string( err );
     }
 
-    // === Substitute arguments into lambda body ====
-    auto lambda_end = lambda->aspects[2]->tk.get();
-    auto litr = lambda->aspects[2]->tk->aspects.begin();
-    std::advance( litr, 1 );
+    // === Bind arguments in a new frame ====
+    auto formals = lambda->aspects[0].tk.get();
+    auto frame = psil_parser::make_token( NK::FRAME );
+    auto litr = formals->aspects.begin();
     auto aitr = app->aspects.begin();
-    std::advance( aitr, 2 );
-
-    for ( ; litr != lambda_end->aspects.end() && (*litr)->elem_type == TE_Type::TOKEN;  ) {
-      // Replace arguments
-      find_replace( lambda->aspects[3]->tk, (*litr)->tk, (*aitr)->tk );
-      // Erase arguments from lambda and application
-      (*litr).reset(); (*aitr).reset();
-      litr = lambda->aspects[2]->tk->aspects.erase( litr );
-      aitr = app->aspects.erase( aitr );
+    std::advance( aitr, 1 );
+    for ( ; litr != formals->aspects.end() && litr->elem_type == TE_Type::TOKEN; ++litr, ++aitr ) {
+      //                 <variable>    <identifier>
+      frame->aspects.emplace_back( litr->tk->aspects.front().tk->aspects.front().s );
+      frame->aspects.emplace_back( std::move( aitr->tk ) );
     }
-
-    // === Double check for errors while applying ===
-    lambda_args = lambda->aspects[2]->tk->aspects.size() - 2;
-    app_args = app->aspects.size() - 3;
-
-    if ( lambda_args != 0 || app_args != 0 ) {
+    if ( litr != formals->aspects.end() ) {
       throw std::string( "Error while applying lambda expression" );
     }
+    // Closures keep the frame they were made in, lambdas applied where written use the running one
+    if ( lambda->vtype != VarType::PROC ) {
+      if ( s->env != nullptr ) { frame->aspects.emplace_back( s->env.share() ); }
+    } else if ( lambda->aspects.size() > 2 ) {
+      frame->aspects.emplace_back( lambda->aspects[2].tk.share() );
+    }
 
-    // === Update AST with result of lambda application ===
-    auto body = std::move( lambda->aspects[3]->tk );
-    node = std::move( body->aspects.front()->tk );
+    // === Body takes the place of the application, exec runs it in the frame ===
+    // Lambda may be the value of a variable, so its body is run through a handle
+    auto body = lambda->aspects[1].tk->aspects.front().tk.share();
+    s->env = std::move( frame );
+    node = std::move( body );
   }
 
 }
@@ -15,6 +15,10 @@
 #include <fstream>
 #include <cmath>
 
+namespace psil_vm {
+  class vm_t;
+}
+
 namespace psil_exec {
 
   // Forward declarations
@@ -28,34 +32,46 @@ namespace psil_exec {
   
   // redeclare for ease of use
   using TE_Type = psil_parser::token_elem_t::TE_Type;
+  using NK = psil_parser::node_kind;
+  using HK = psil_parser::head_kind;
   // shorten long types
-  using token_ptr = std::unique_ptr<psil_parser::token_t>;
+  using token_ptr = psil_parser::token_ptr;
   using stack_ptr = std::unique_ptr<stack_t>;
-  using symbol_table_t = std::map<std::string, std::unique_ptr<stack_elem_t> >;
+  // keyed by interned name, see psil_parser::intern_str
+  using symbol_table_t = std::unordered_map<const std::string *, std::unique_ptr<stack_elem_t> >;
 
   // types of variables
-  enum VarType { BOOL, CHAR, NUM, LIST, PROC, SYMBOL, UNKNOWN, ERROR };
+  using VarType = psil_parser::VarType;
+
+  // Deepest nesting of lambda calls allowed when --max-depth is not given
+  const size_t DEFAULT_MAX_DEPTH = 1 << 20;
   
   // ===================================================================================
   // ========== Internal Helper Functions ==============================================
   // ===================================================================================
   
   /**
-     Copies token recursively
+     Copies token recursively, shared tokens are shared by the copy
   */
   token_ptr copy_tk( const token_ptr & tk );
 
   /**
-     Compares two tokens recursively
+     Copies token recursively without sharing, and clears lexical addresses
+     Used for code that runs away from where it was written, such as arguments passed as written
   */
-  bool equal_tk( const token_ptr & tk1, const token_ptr & tk2 );
+  token_ptr copy_unresolved( const token_ptr & tk );
 
   /**
-     Finds token 'what' within token 'where', and replaces occurences with token 'that'
-     which is copied to the new location
+     Checks if expression needs no more running, constants and closures
   */
-  bool find_replace( token_ptr & where, const token_ptr & what, token_ptr & that );
-  
+  bool is_value( const token_ptr & node );
+
+  /**
+     Compares two tokens recursively
+     Shared tokens are equal at once, values with different hashes differ at once
+  */
+  bool equal_tk( const token_ptr & tk1, const token_ptr & tk2 );
+
   /**
      Checks type of token
      Assumes top level token is an expression
@@ -80,12 +96,14 @@ namespace psil_exec {
   /**
      Represents a single element in symbol table,
      Stores value and some information about the variable
+     Value is shared with the code that defined or read it,
+       exec owns a token before changing it, so the value is never changed in place
   */
   struct stack_elem_t {
     stack_elem_t( std::string n, VarType t, const token_ptr & v ) :
-      var_name(n), type(t), value( copy_tk( v ) ), scope_lvl(0) {}
+      var_name(n), type(t), value( v.share() ), scope_lvl(0) {}
     stack_elem_t( std::string n, VarType t, const token_ptr & v, size_t sl ) :
-      var_name(n), type(t), value( copy_tk( v ) ), scope_lvl(sl) {}
+      var_name(n), type(t), value( v.share() ), scope_lvl(sl) {}
 
     std::string var_name;
     VarType type;
@@ -101,19 +119,28 @@ namespace psil_exec {
     // Used to represent where a variable is defined
     enum ExistsType { NO, GLOBAL, LOCAL };
 
-    stack_t() { init(); }
+    stack_t();
+    ~stack_t();
     
     void init();
     void push();
     void pop();
 
-    ExistsType exists( std::string n );
-    void add( std::string n, const token_ptr & v );
-    void update( std::string n, ExistsType e, const token_ptr & v );
-    token_ptr get( std::string n, ExistsType e );
+    // Names are interned
+    stack_elem_t * find( const std::string * n, ExistsType & e );
+    ExistsType exists( const std::string * n );
+    void add( const std::string * n, const token_ptr & v );
+    void update( const std::string * n, ExistsType e, const token_ptr & v );
+    token_ptr get( const std::string * n, ExistsType e );
 
     symbol_table_t global_table;
     std::vector< symbol_table_t > table;
+    token_ptr env; // frame of the running lambda, nullptr outside of lambdas
+    size_t depth; // lambda calls exec is running, that are not tail calls
+    size_t max_depth; // past it "Stack depth exceeded" is thrown
+    uintptr_t stack_limit; // lowest address of the native stack exec may use, 0 if unknown
+    psil_eval::literal_pool_t literals; // constants of the code run on this stack
+    std::unique_ptr<psil_vm::vm_t> vm; // runs the code run on this stack when set, instead of exec
   };
   
   // ===================================================================================
@@ -123,11 +150,73 @@ namespace psil_exec {
      This function does the evaluation and printing
      @param lang - anguage to parse input using
      @param input - input to evaluate
+     @param use_vm - run input with the bytecode vm instead of exec
+     @param max_depth - deepest nesting of lambda calls allowed
+  */
+  void repl( const std::unique_ptr<psil_parser::language_t> & lang, std::string input, bool use_vm,
+	     size_t max_depth );
+
+  /**
+     Parse, verify and execute input using an existing stack
+     @param lang - language to parse input using
+     @param stack - stack with the scope to run input in
+     @param input - input to evaluate
+     @return whether input ran without errors
+  */
+  bool run_input( const std::unique_ptr<psil_parser::language_t> & lang,
+		  stack_ptr & stack, const std::string & input );
+
+  /**
+     Parse, verify and lower input
+     @param lang - language to parse input using
+     @param input - input to parse
+     @param checked - set to whether verification found no errors
+     @return lowered ast of input, nullptr if it could not be parsed or verified
   */
-  void repl( const std::unique_ptr<psil_parser::language_t> & lang, std::string input );
+  token_ptr read_input( const std::unique_ptr<psil_parser::language_t> & lang,
+			const std::string & input, bool & checked );
 
-  // Perform single read evaluate print cycle for contents of file
-  void run_file( const std::unique_ptr<psil_parser::language_t> & lang, std::string filename );
+  /**
+     Execute verified ast using an existing stack
+     Constants of ast are pooled in the stack's literal pool first,
+       ast is run by the stack's vm if it has one
+     @param stack - stack with the scope to run ast in
+     @param ast - ast to execute, rewritten while running
+     @return whether ast ran without errors
+  */
+  bool exec_input( stack_ptr & stack, token_ptr & ast );
+
+  /**
+     Form Reader
+     Reads a source file one top level form at a time,
+     the file is mapped into memory if possible, otherwise read through a stream
+  */
+  class form_reader_t {
+  public:
+    form_reader_t( const std::string & filename );
+    ~form_reader_t();
+    form_reader_t( const form_reader_t & ) = delete;
+    form_reader_t & operator=( const form_reader_t & ) = delete;
+
+    bool good() const;
+    bool next( std::string & form );
+    std::string_view contents() const;
+
+  private:
+    int get();
+
+    const char * data;
+    size_t size;
+    size_t pos;
+    std::ifstream stream;
+  };
+
+  // Run contents of file one top level form at a time, sharing one scope,
+  //  with the bytecode vm instead of exec when use_vm is set
+  void run_file( const std::unique_ptr<psil_parser::language_t> & lang, std::string filename,
+		 bool use_vm, size_t max_depth );
+  void run_forms( const std::unique_ptr<psil_parser::language_t> & lang, stack_ptr & stack,
+		  form_reader_t & code, const std::string & filename );
 
   // ===================================================================================
   // ================== Exec functions =================================================
@@ -135,6 +224,8 @@ namespace psil_exec {
   
   /**
      Executes the abstract syntax tree given
+     Code that replaces the tree (applied lambdas, if branches, last expressions of begin)
+       runs in the same call, so tail calls do not grow the stack
      if rem is true, then delete that branch
   */
   void exec( stack_ptr & s, token_ptr & ast, bool& rem );
@@ -161,8 +252,21 @@ namespace psil_exec {
   void exec_def( stack_ptr & s, token_ptr & node  );
 
   //   Replaces variables with their value, returns true if global procedure name
+  //   Arguments of the running lambda are found first by their lexical address,
+  //   then the symbol table
   bool exec_var( stack_ptr & s, token_ptr & node, bool& rem );
 
+  //   Finds the value of argument name in frame or the frames around it, nullptr if unbound
+  const token_ptr * find_arg( const psil_parser::token_t * frame, const std::string * name );
+
+  //   Finds the value of argument name at its lexical address, depth frames up at slot,
+  //   by name if the frame there does not bind it
+  const token_ptr * find_arg( const psil_parser::token_t * frame, size_t depth, size_t slot,
+			      const std::string * name );
+
+  //   Makes the lambda expression given a closure over the frame of the running lambda
+  void make_closure( stack_ptr & s, token_ptr & node );
+
     /**
      Executes the application of procedures
      Assumes the node given is the expression token containing the application
@@ -173,6 +277,8 @@ namespace psil_exec {
   /**
      Executes the lambda expression given
      Assume the node given is the expression token containing the lambda
+     Arguments are bound in a new frame on top of the environment of the lambda,
+       the frame becomes the environment and the body replaces node, for exec to run
      if rem is true, then delete that branch
   */
   void apply_lambda( stack_ptr & s, token_ptr & node, bool& rem );
@@ -198,7 +304,12 @@ namespace psil_exec {
   // Helper functions to make tokens
   token_ptr make_boolean( bool val );
   token_ptr make_character( std::string val );
-  token_ptr make_number( std::string val, bool int_or_dec );
+  token_ptr make_integer( long long val );
+  token_ptr make_decimal( long double val );
+
+  // Helper functions to read numbers, both throw if the number does not fit
+  long long integer_value( psil_parser::token_t * num );
+  long double decimal_value( psil_parser::token_t * num );
 
   // ===================================================================================
   // ===== Global functions ============================================================
@@ -261,6 +372,9 @@ namespace psil_exec {
   // Quote
   // Convert psil code into quoted datums
   void psil_quote( stack_ptr & s, token_ptr & node );
+  // Write arguments of the running frame into code given to to_quote, so it stands
+  // alone outside of its lambda, variables bound by lambdas inside the code are left alone
+  void write_frame( stack_ptr & s, token_ptr & code );
   // Convert quoted datum's into runable code
   void psil_unquote( stack_ptr & s, token_ptr & node );
   // Identity predicates ================================
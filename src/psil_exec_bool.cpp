@@ -11,28 +11,39 @@
 
 namespace psil_exec {
 
-  // Create and return a boolean constant expression
-  token_ptr make_boolean( bool val ) {
+  // Build a boolean constant expression
+  static token_ptr build_boolean( bool val ) {
     // Make expression
-    auto tmp_exp = std::make_unique<psil_parser::token_t>( "<expression>" );
+    auto tmp_exp = psil_parser::make_token( NK::EXPRESSION );
     // Make constant
-    auto tmp_con = std::make_unique<psil_parser::token_t>( "<constant>" );
+    auto tmp_con = psil_parser::make_token( NK::CONSTANT );
+    tmp_con->vtype = VarType::BOOL;
     // Make number
-    auto tmp_boo = std::make_unique<psil_parser::token_t>( "<boolean>" );
+    auto tmp_boo = psil_parser::make_token( NK::BOOLEAN );
     // Add val to integer
     std::string str_val = ( val ) ? "#t" : "#f";
-    auto tmp_val = std::make_unique<psil_parser::token_elem_t>( str_val );
+    auto tmp_val = psil_parser::token_elem_t( str_val );
     tmp_boo->aspects.push_back( std::move( tmp_val ) );
     // Add boolean to const
-    auto elem_boo = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_boo ) );
+    auto elem_boo = psil_parser::token_elem_t( std::move( tmp_boo ) );
     tmp_con->aspects.push_back( std::move( elem_boo ) );
     // Add const to expression
-    auto elem_con = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_con ) );
+    auto elem_con = psil_parser::token_elem_t( std::move( tmp_con ) );
     tmp_exp->aspects.push_back( std::move( elem_con ) );
     
     return tmp_exp;
    }
 
+  // Return shared boolean constant expression, both are made once
+  token_ptr make_boolean( bool val ) {
+    static token_ptr * values = nullptr; // never freed, outlives every arena
+    if ( values == nullptr ) {
+      psil_parser::arena_t::use_t perm( psil_parser::arena_t::permanent() );
+      values = new token_ptr[2] { build_boolean( false ), build_boolean( true ) };
+    }
+    return values[ val ? 1 : 0 ].share();
+  }
+
   // ========================= BOOLEAN OPERATIONS ================================================
   
   // Performs logical and on all arguments
@@ -41,10 +52,10 @@ namespace psil_exec {
     size_t idx = 0;
     std::string val = "";
     bool ret = true;
-    auto itr = node->aspects.front()->tk->aspects.begin();
-    for ( ; itr != node->aspects.front()->tk->aspects.end(); ++itr, ++idx ) {
-      if ( idx > 1 && idx < node->aspects.front()->tk->aspects.size() - 1 ) { // Just arguments of function
-	if ( !is_true( s, (*itr)->tk ) ) {
+    auto itr = node->aspects.front().tk->aspects.begin();
+    for ( ; itr != node->aspects.front().tk->aspects.end(); ++itr, ++idx ) {
+      if ( idx > 0 ) { // Just arguments of function
+	if ( !is_true( s, itr->tk ) ) {
 	  ret = false;
 	  break;
 	}
@@ -59,10 +70,10 @@ namespace psil_exec {
     //std::cout << "OR" << std::endl;
     size_t idx = 0;
     bool ret = false;
-    auto itr = node->aspects.front()->tk->aspects.begin();
-    for ( ; itr != node->aspects.front()->tk->aspects.end(); ++itr, ++idx ) {
-      if ( idx > 1 && idx < node->aspects.front()->tk->aspects.size() - 1 ) { // Just arguments of function
-	if ( is_true( s, (*itr)->tk ) ) {
+    auto itr = node->aspects.front().tk->aspects.begin();
+    for ( ; itr != node->aspects.front().tk->aspects.end(); ++itr, ++idx ) {
+      if ( idx > 0 ) { // Just arguments of function
+	if ( is_true( s, itr->tk ) ) {
 	  ret = true;
 	  break;
 	}
@@ -74,7 +85,7 @@ namespace psil_exec {
 
   // Performs logical negation on all arguments
   void psil_not( stack_ptr & s, token_ptr & node ) {
-    bool ret = is_true( s, node->aspects.front()->tk->aspects[2]->tk );
+    bool ret = is_true( s, node->aspects.front().tk->aspects[1].tk );
     auto ret_bool = make_boolean( !ret );
     node = std::move( ret_bool );
   }
@@ -82,8 +93,8 @@ namespace psil_exec {
   // Checks the two arguments for equality
   void psil_is_equal( stack_ptr & s, token_ptr & node ) {
     std::string val;
-    auto app = node->aspects.front()->tk.get();
-    bool ret = equal_tk( app->aspects[2]->tk, app->aspects[3]->tk );
+    auto app = node->aspects.front().tk.get();
+    bool ret = equal_tk( app->aspects[1].tk, app->aspects[2].tk );
     auto ret_bool = make_boolean( ret );
     node = std::move( ret_bool );
   }
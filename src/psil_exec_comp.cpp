@@ -18,16 +18,9 @@ namespace psil_exec {
     }
 
     //       <expression>          <constant>           <number>
-    auto num = node->aspects.front()->tk->aspects.front()->tk.get();
-    //              <number>             <int/dec>             value
-    std::string val = num->aspects.front()->tk->aspects.front()->str;
-    if ( val.size() > 18 ) throw std::string( "Number overflow" );
-    try {
-      return stold( val );
-    } catch ( ... ) {
-      throw std::string( "Conversion error" );
-    }
-    return 0.0;
+    auto num = node->aspects.front().tk->aspects.front().tk.get();
+    //                    <number>            <int/dec>
+    return decimal_value( num->aspects.front().tk.get() );
   }
 
   // Pull value out of character as a string
@@ -37,9 +30,9 @@ namespace psil_exec {
     }
 
     //       <expression>          <constant>           <character>
-    auto num = node->aspects.front()->tk->aspects.front()->tk.get();
+    auto num = node->aspects.front().tk->aspects.front().tk.get();
     //              <character>           value
-    return psil_char( num->aspects.front()->str );
+    return psil_char( num->aspects.front().str() );
   }
 
   // =================== Comparison Functions =======================================
@@ -48,9 +41,9 @@ namespace psil_exec {
   void psil_num_compare( token_ptr & node,
 			 std::function<bool(long double, long double)> comp ) {
     try {
-      auto app = node->aspects.front()->tk.get();
-      long double arg1 = psil_get_double( app->aspects[2]->tk );
-      long double arg2 = psil_get_double( app->aspects[3]->tk );
+      auto app = node->aspects.front().tk.get();
+      long double arg1 = psil_get_double( app->aspects[1].tk );
+      long double arg2 = psil_get_double( app->aspects[2].tk );
 
       auto ret = make_boolean( comp( arg1, arg2 ) );
       node = std::move( ret );
@@ -63,9 +56,9 @@ namespace psil_exec {
   void psil_char_compare( token_ptr & node,
 			 std::function<bool(std::string, std::string)> comp ) {
     try {
-      auto app = node->aspects.front()->tk.get();
-      std::string arg1 = psil_get_char( app->aspects[2]->tk );
-      std::string arg2 = psil_get_char( app->aspects[3]->tk );
+      auto app = node->aspects.front().tk.get();
+      std::string arg1 = psil_get_char( app->aspects[1].tk );
+      std::string arg2 = psil_get_char( app->aspects[2].tk );
 
       auto ret = make_boolean( comp( arg1, arg2 ) );
       node = std::move( ret );
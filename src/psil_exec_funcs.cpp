@@ -12,18 +12,18 @@ namespace psil_exec {
 
   // === Take function name and apply correct function
   void apply_global_proc( stack_ptr & s, token_ptr & node, bool& rem, std::string fun ) {
-    size_t arg_count = node->aspects.front()->tk->aspects.size()-3;
+    size_t arg_count = node->aspects.front().tk->aspects.size()-1;
     // ==============================  Input / Output ===================================
     if ( fun == "print" ) {
       if ( arg_count < 1 )
 	throw std::string( "print: Wrong number of arguments given, 1+ expected" );
       rem = true;
-      print( node->aspects.front()->tk, false);
+      print( node->aspects.front().tk, false);
     } else if ( fun == "println" ) {
       if ( arg_count < 1 )
 	throw std::string( "println: Wrong number of arguments given, 1+ expected" );
       rem = true;
-      print( node->aspects.front()->tk, true );
+      print( node->aspects.front().tk, true );
     } else if ( fun == "read" ) {
       if ( arg_count != 0 )
 	throw std::string( "read: Wrong number of arguments given, 0 expected" );
@@ -300,40 +300,46 @@ namespace psil_exec {
 
   // === Converts token back into printable string
   std::string tk_to_string( token_ptr & tk ) {
-    if ( tk->type_name == "<constant>" || tk->type_name == "<datum>" ) {
-      auto const_type = tk->aspects.front()->tk.get();
-      if ( const_type->type_name == "<boolean>" ) {
-	return const_type->aspects.front()->str + " ";
-      } else if ( const_type->type_name == "<number>" ) {
-	return const_type->aspects.front()->tk->aspects.front()->str + " ";
-      } else if ( const_type->type_name == "<character>" ) {
-	return psil_char( const_type->aspects.front()->str );
-      } else if ( const_type->type_name == "<symbol>" ) {
-	auto iden = const_type->aspects.front()->tk.get();
-	if ( iden->aspects.front()->elem_type == TE_Type::TOKEN ) {
+    if ( tk->kind == NK::CONSTANT || tk->kind == NK::DATUM ) {
+      auto const_type = tk->aspects.front().tk.get();
+      switch ( const_type->kind ) {
+      case NK::BOOLEAN:
+	return const_type->aspects.front().str() + " ";
+      case NK::NUMBER:
+	return psil_parser::write_number( const_type->aspects.front().tk.get() ) + " ";
+      case NK::CHARACTER:
+	return psil_char( const_type->aspects.front().str() );
+      case NK::SYMBOL: {
+	auto iden = const_type->aspects.front().tk.get();
+	if ( iden->aspects.front().elem_type == TE_Type::TOKEN ) {
 	  // Keyword or Operator
-	  return iden->aspects.front()->tk->aspects.front()->str + " ";
+	  return iden->aspects.front().tk->aspects.front().str() + " ";
 	} else {
 	  // Locally defined name
-	  return iden->aspects.front()->str + " ";
+	  return iden->aspects.front().str() + " ";
 	}
-      } else if ( const_type->type_name == "<list_def>" ) {
-	std::string ret = tk_to_string( const_type->aspects[2]->tk );
+      }
+      case NK::LIST_DEF: {
+	std::string ret = tk_to_string( const_type->aspects.front().tk );
 	return "'" + ret;
-      } else if ( const_type->type_name == "<list>" ) {
+      }
+      case NK::LIST: {
 	std::string ret = "";
 	for ( auto itr = const_type->aspects.begin(); itr != const_type->aspects.end(); ++itr ) {
-	  if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	    ret += tk_to_string( (*itr)->tk );
+	  if ( itr->elem_type == TE_Type::TOKEN ) {
+	    ret += tk_to_string( itr->tk );
 	  }
 	}
 	return "( " + ret + ")";
       }
+      default:
+	break;
+      }
     } else {
       std::string ret = "";
       for ( auto itr = tk->aspects.begin(); itr != tk->aspects.end(); ++itr ) {
-	if ( (*itr)->elem_type == TE_Type::TOKEN ) {
-	  ret += tk_to_string( (*itr)->tk );
+	if ( itr->elem_type == TE_Type::TOKEN && itr->tk->kind != NK::FRAME ) {
+	  ret += tk_to_string( itr->tk );
 	}
       }
       return ret;
@@ -345,10 +351,10 @@ namespace psil_exec {
   void print( token_ptr & node, bool newline ) {
     size_t idx = 0;
     for ( auto itr = node->aspects.begin(); itr != node->aspects.end(); ++itr, ++idx ) {
-      if ( idx > 1 && idx < node->aspects.size() - 1 ) { // Just arguments of function call
-	if ( (*itr)->elem_type == TE_Type::TOKEN && (*itr)->tk->aspects.size() == 1 &&
-	     (*itr)->tk->aspects.front()->elem_type == TE_Type::TOKEN ) {
-	  std::cout << tk_to_string( (*itr)->tk );
+      if ( idx > 0 ) { // Just arguments of function call
+	if ( itr->elem_type == TE_Type::TOKEN && itr->tk->aspects.size() == 1 &&
+	     itr->tk->aspects.front().elem_type == TE_Type::TOKEN ) {
+	  std::cout << tk_to_string( itr->tk );
 	}
       }
     }
@@ -362,49 +368,46 @@ namespace psil_exec {
     std::cin >> str;
 
     // Reset application to <constant>
-    node->aspects.front()->tk->type_name = "<constant>";
-    node->aspects.front()->tk->aspects.clear();
+    node->aspects.front().tk->kind = NK::CONSTANT;
+    node->aspects.front().tk->head = HK::NONE;
+    node->aspects.front().tk->vtype = VarType::LIST;
+    node->aspects.front().tk->aspects.clear();
     // <constant> -> <list_def>
-    auto tmp_top = std::make_unique<psil_parser::token_t>("<list_def>");
+    auto tmp_top = psil_parser::make_token( NK::LIST_DEF, HK::QUOTE );
     // <list_def> -> (quote <datum>)
-    auto tmp_mid = std::make_unique<psil_parser::token_t>("<datum>");
+    auto tmp_mid = psil_parser::make_token( NK::DATUM );
+    tmp_mid->vtype = VarType::LIST;
     // <datum> -> <list> -> (...)
-    auto tmp_bot = std::make_unique<psil_parser::token_t>("<list>");
-    // Add starting paren to list
-    tmp_bot->aspects.push_back( std::make_unique<psil_parser::token_elem_t>("(") );
+    auto tmp_bot = psil_parser::make_token( NK::LIST, HK::PAREN );
 
     // === Convert string to (quote (<character>+))
     for ( char c : str ) {
       std::string val;
       val = psil_char( c );
       // Create character datum
-      auto tmp_char_top = std::make_unique<psil_parser::token_t>("<datum>");
-      auto tmp_char_bot = std::make_unique<psil_parser::token_t>("<character>");
+      auto tmp_char_top = psil_parser::make_token( NK::DATUM );
+      tmp_char_top->vtype = VarType::CHAR;
+      auto tmp_char_bot = psil_parser::make_token( NK::CHARACTER );
       // Add value to character
-      tmp_char_bot->aspects.push_back( std::make_unique<psil_parser::token_elem_t>( val ) );
+      tmp_char_bot->aspects.push_back( psil_parser::token_elem_t( val ) );
       // Add character to datum
-      auto ch_elem_bot = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_char_bot ) );
+      auto ch_elem_bot = psil_parser::token_elem_t( std::move( tmp_char_bot ) );
       tmp_char_top->aspects.push_back( std::move( ch_elem_bot ) );
       // Add character to list's datum
-      auto ch_elem_top = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_char_top ) );
+      auto ch_elem_top = psil_parser::token_elem_t( std::move( tmp_char_top ) );
       tmp_bot->aspects.push_back( std::move( ch_elem_top ) );
     }
 
-    // Add ending paren to list
-    tmp_bot->aspects.push_back( std::make_unique<psil_parser::token_elem_t>(")") );
     // Add list to <datum>  
-    auto elem_bot = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_bot ) );
+    auto elem_bot = psil_parser::token_elem_t( std::move( tmp_bot ) );
     tmp_mid->aspects.push_back( std::move( elem_bot ) );
     
     // Build <list_def>
-    tmp_top->aspects.push_back( std::make_unique<psil_parser::token_elem_t>( "(" ) );
-    tmp_top->aspects.push_back( std::make_unique<psil_parser::token_elem_t>( "quote" ) );
-    auto elem_mid = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_mid ) );
+    auto elem_mid = psil_parser::token_elem_t( std::move( tmp_mid ) );
     tmp_top->aspects.push_back( std::move( elem_mid ) );
-    tmp_top->aspects.push_back( std::make_unique<psil_parser::token_elem_t>( ")" ) );
     // Connect <list_def> to <constant>
-    auto elem_top = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_top ) );
-    node->aspects.front()->tk->aspects.push_back( std::move( elem_top ) );
+    auto elem_top = psil_parser::token_elem_t( std::move( tmp_top ) );
+    node->aspects.front().tk->aspects.push_back( std::move( elem_top ) );
 
   }
 
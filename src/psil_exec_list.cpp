@@ -13,58 +13,86 @@ namespace psil_exec {
 
   // ============= List ==============================================
 
+  // Own the quoted argument down to its <list_def>, so it can be changed
+  //  constants are pooled and shared until owned
+  static psil_parser::token_t * own_list_def( token_ptr & arg_exp ) {
+    arg_exp.own(); // may be the value of a variable
+    //       <expression>         <constant>
+    auto & constant = arg_exp->aspects.front().tk;
+    constant.own();
+    constant->hash = 0; // changed in place
+    //      <constant>            <list_def>
+    auto & list_def = constant->aspects.front().tk;
+    list_def.own();
+    return list_def.get();
+  }
+
+  // Own <list_def> down to its <list>, so elements can be changed
+  static psil_parser::token_t * own_list( psil_parser::token_t * list_def ) {
+    //       <list_def>             <datum>
+    auto & datum = list_def->aspects.front().tk;
+    datum.own();
+    datum->hash = 0;
+    //      <datum>             <list>
+    auto & list = datum->aspects.front().tk;
+    list.own();
+    return list.get();
+  }
+
   void psil_length( token_ptr & node ) {
     // Verify that argument is list
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::LIST ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::LIST ) {
       throw std::string( "list operation procedure argument must be list" );
     }
 
     // Get reference to list
     //        <expression>          <application>       <expression>
-    auto arg_exp = node->aspects.front()->tk->aspects[2]->tk.get();
+    auto arg_exp = node->aspects.front().tk->aspects[1].tk.get();
     //          <expression>             <constant>            <list_def>
-    auto list_def = arg_exp->aspects.front()->tk->aspects.front()->tk.get();
+    auto list_def = arg_exp->aspects.front().tk->aspects.front().tk.get();
     //         <list_def>            <datum>
-    auto datum = list_def->aspects[2]->tk.get();
+    auto datum = list_def->aspects.front().tk.get();
     //          <datum>               <list>
-    auto list = datum->aspects.front()->tk.get();
-    size_t len = list->aspects.size() - 2;
+    auto list = datum->aspects.front().tk.get();
+    size_t len = list->aspects.size();
 
     // Return result
-    auto num = make_number( std::to_string( len ), true );
+    auto num = make_integer( len );
     node = std::move( num );
   }
   
   void psil_get_list( token_ptr & node, long pos ) {
     // Verify that argument is list
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::LIST ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::LIST ) {
       throw std::string( "list operation procedure argument must be list" );
     }
 
     // Get reference to list
-    //        <expression>          <application>       <expression>
-    auto arg_exp = node->aspects.front()->tk->aspects[2]->tk.get();
-    //          <expression>             <constant>            <list_def>
-    auto list_def = arg_exp->aspects.front()->tk->aspects.front()->tk.get();
+    //                     <expression>          <application>      <expression>
+    auto list_def = own_list_def( node->aspects.front().tk->aspects[1].tk );
     //         <list_def>            <datum>
-    auto datum = list_def->aspects[2]->tk.get();
+    auto datum = list_def->aspects.front().tk.get();
     //          <datum>               <list>
-    auto list = datum->aspects.front()->tk.get();
+    auto list = datum->aspects.front().tk.get();
     // Grab element if possible
-    long len = list->aspects.size()-2;
+    long len = list->aspects.size();
     if ( pos < 0 ) {
       pos = len + pos + 1;
     }
     if ( pos < 0 || pos >= len ) {
       throw std::string( "Out of bounds" );
     } else {
-      auto elem = std::move( list->aspects[pos+1]->tk );
+      auto elem = list->aspects[pos].tk.share();
+      // Constant now holds the element, and its type
+      //              <expression>          <application>      <expression>       <constant>
+      auto constant = node->aspects.front().tk->aspects[1].tk->aspects.front().tk.get();
+      constant->vtype = elem->vtype;
       // Update datum
-      list_def->aspects[2]->tk = std::move( elem );
+      list_def->aspects.front().tk = std::move( elem );
       // Return updated list
-      auto quote = std::move( node->aspects.front()->tk->aspects[2]->tk );
+      auto quote = std::move( node->aspects.front().tk->aspects[1].tk );
       node = std::move( quote );
     }
   }
@@ -72,35 +100,30 @@ namespace psil_exec {
   void psil_set_list( token_ptr & node, long pos ) {
     // Check if first argument is a list
     //        <expression>          <application>
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::LIST ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::LIST ) {
       throw std::string( "list operation procedure argument 1 must be list" );
     }
 
     // Check if second argument is a quote
     //      <application>         <expression>     token_element
-    auto arg2_elem = app->aspects[3]->tk->aspects.front().get();
+    auto arg2_elem = &app->aspects[2].tk->aspects.front();
     if ( arg2_elem->elem_type != TE_Type::TOKEN ||
-	 arg2_elem->tk->type_name != "<constant>" ||
-	 arg2_elem->tk->aspects.front()->tk->type_name != "<list_def>" ) {
+	 arg2_elem->tk->kind != NK::CONSTANT ||
+	 arg2_elem->tk->aspects.front().tk->kind != NK::LIST_DEF ) {
       throw std::string( "list set operation procedure argument 2 must be quoted" );
     }
 
     // Pull out second argument
     //                     token_element     <constant>         <list_def>      <datum> 
-    auto arg2_datum = std::move( arg2_elem->tk->aspects.front()->tk->aspects[2]->tk );
+    auto arg2_datum = arg2_elem->tk->aspects.front().tk->aspects.front().tk.share();
     
     // Get reference to list
-    //        <expression>          <application>      <expression>
-    auto arg1_exp = node->aspects.front()->tk->aspects[2]->tk.get();
-    //          <expression>             <constant>            <list_def>
-    auto list_def = arg1_exp->aspects.front()->tk->aspects.front()->tk.get();
-    //         <list_def>            <datum>
-    auto datum = list_def->aspects[2]->tk.get();
-    //          <datum>               <list>
-    auto list = datum->aspects.front()->tk.get();
+    //                     <expression>          <application>      <expression>
+    auto list_def = own_list_def( node->aspects.front().tk->aspects[1].tk );
+    auto list = own_list( list_def );
     // Check for bounds
-    long len = list->aspects.size()-2;
+    long len = list->aspects.size();
     if ( pos < 0 ) {
       pos = len + pos + 1;
     }
@@ -108,31 +131,31 @@ namespace psil_exec {
       throw std::string( "Out of bound" );
     } else {
       // Update list
-      list->aspects[pos+1]->tk = std::move( arg2_datum );
+      list->aspects[pos].tk = std::move( arg2_datum );
       // Return updated list
-      auto quote = std::move( node->aspects.front()->tk->aspects[2]->tk );
+      auto quote = std::move( node->aspects.front().tk->aspects[1].tk );
       node = std::move( quote );
     }
     
   }
   void psil_get_nth( token_ptr & node ) {
     // Check if second argument is a number
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[3]->tk ) != VarType::NUM ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[2].tk ) != VarType::NUM ) {
       throw std::string( "list operation procedure argument 2 must be number" );
     }
 
     // Convert argument into integer value
     //     <application>     <expression>         <constant>          <number>
-    auto num = app->aspects[3]->tk->aspects.front()->tk->aspects.front()->tk.get();
-    if ( num->aspects.front()->tk->type_name != "<integer>" ) {
+    auto num = app->aspects[2].tk->aspects.front().tk->aspects.front().tk.get();
+    if ( num->aspects.front().tk->kind != NK::INTEGER ) {
       throw std::string( "Index must be integer" );
     }
 
     long pos = 0;
     try {
       //               <number>            <integer>            val
-      pos = std::stol( num->aspects.front()->tk->aspects.front()->str );
+      pos = integer_value( num->aspects.front().tk.get() );
     } catch ( ... ) {
       throw std::string( "Number error" );
     }
@@ -142,22 +165,22 @@ namespace psil_exec {
   }
   void psil_set_nth( token_ptr & node ) {
     // Verify third argument is a number
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[4]->tk ) != VarType::NUM ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[3].tk ) != VarType::NUM ) {
       throw std::string( "list operation procedure argument 3 must be number" );
     }
 
     // Convert argument into integer value
     //     <application>     <expression>         <constant>          <number>
-    auto num = app->aspects[4]->tk->aspects.front()->tk->aspects.front()->tk.get();
-    if ( num->aspects.front()->tk->type_name != "<integer>" ) {
+    auto num = app->aspects[3].tk->aspects.front().tk->aspects.front().tk.get();
+    if ( num->aspects.front().tk->kind != NK::INTEGER ) {
       throw std::string( "Index must be integer" );
     }
 
     long pos = 0;
     try {
       //               <number>            <integer>            val
-      pos = std::stoll( num->aspects.front()->tk->aspects.front()->str );
+      pos = integer_value( num->aspects.front().tk.get() );
     } catch ( ... ) {
       throw std::string( "Number error" );
     }
@@ -168,37 +191,32 @@ namespace psil_exec {
   
   void psil_append( token_ptr & node, long location ) {
     // First argument is a list
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::LIST ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::LIST ) {
       throw std::string( "list operation procedure argument must be list" );
     }
 
     // Check if second argument is quoted
     //      <application>         <expression>     token_element
-    auto arg2_elem = app->aspects[3]->tk->aspects.front().get();
+    auto arg2_elem = &app->aspects[2].tk->aspects.front();
     if ( arg2_elem->elem_type != TE_Type::TOKEN ||
-	 arg2_elem->tk->type_name != "<constant>" ||
-	 arg2_elem->tk->aspects.front()->tk->type_name != "<list_def>" ) {
+	 arg2_elem->tk->kind != NK::CONSTANT ||
+	 arg2_elem->tk->aspects.front().tk->kind != NK::LIST_DEF ) {
       throw std::string( "list set operation procedure argument 2 must be quoted" );
     }
 
     // Pull out second argument
     //                     token_element     <constant>         <list_def>      <datum> 
-    auto arg2_datum = std::move( arg2_elem->tk->aspects.front()->tk->aspects[2] );
+    auto arg2_datum = psil_parser::token_elem_t( arg2_elem->tk->aspects.front().tk->aspects.front().tk.share() );
 
     // Grab element from list
-    //        <expression>          <application>       <expression>
-    auto arg_exp = node->aspects.front()->tk->aspects[2]->tk.get();
-    //          <expression>             <constant>            <list_def>
-    auto list_def = arg_exp->aspects.front()->tk->aspects.front()->tk.get();
-    //         <list_def>            <datum>
-    auto datum = list_def->aspects[2]->tk.get();
-    //          <datum>               <list>
-    auto list = datum->aspects.front()->tk.get();
+    //                     <expression>          <application>      <expression>
+    auto list_def = own_list_def( node->aspects.front().tk->aspects[1].tk );
+    auto list = own_list( list_def );
 
     // Find location to insert
     auto itr = list->aspects.begin();
-    long pos = 0, list_len = list->aspects.size() - 2;
+    long pos = 0, list_len = list->aspects.size();
     if ( location >= 0 ) {
       pos = location;
     } else {
@@ -207,34 +225,34 @@ namespace psil_exec {
     if ( pos < 0 || pos > list_len ) {
       throw std::string( "Index out of bounds" );
     }
-    std::advance( itr, pos+1 );
+    std::advance( itr, pos );
 
     // Insert datum
     list->aspects.insert( itr, std::move( arg2_datum ) );
 
     // Return updated list
-    auto quote = std::move( node->aspects.front()->tk->aspects[2]->tk );
+    auto quote = std::move( node->aspects.front().tk->aspects[1].tk );
     node = std::move( quote );
   }
 
   void psil_insert( token_ptr & node ) {
     // Verifty third argument is number
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[4]->tk ) != VarType::NUM ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[3].tk ) != VarType::NUM ) {
       throw std::string( "list operation procedure argument 2 must be number" );
     }
 
     // Convert argument into integer value
     //     <application>     <expression>         <constant>          <number>
-    auto num = app->aspects[4]->tk->aspects.front()->tk->aspects.front()->tk.get();
-    if ( num->aspects.front()->tk->type_name != "<integer>" ) {
+    auto num = app->aspects[3].tk->aspects.front().tk->aspects.front().tk.get();
+    if ( num->aspects.front().tk->kind != NK::INTEGER ) {
       throw std::string( "Index must be integer" );
     }
 
     long pos = 0;
     try {
       //               <number>            <integer>            val
-      pos = std::stol( num->aspects.front()->tk->aspects.front()->str );
+      pos = integer_value( num->aspects.front().tk.get() );
     } catch ( ... ) {
       throw std::string( "Number error" );
     }
@@ -245,43 +263,38 @@ namespace psil_exec {
 
   void psil_pop( token_ptr & node ) {
     // First argument is a list
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::LIST ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::LIST ) {
       throw std::string( "list operation procedure argument must be list" );
     }
 
     // Second argument is a number
-    if ( check_type( app->aspects[3]->tk ) != VarType::NUM ) {
+    if ( check_type( app->aspects[2].tk ) != VarType::NUM ) {
       throw std::string( "list operation procedure argument 2 must be number" );
     }
     // Convert argument to a integer value
     //     <application>     <expression>         <constant>          <number>
-    auto num = app->aspects[3]->tk->aspects.front()->tk->aspects.front()->tk.get();
-    if ( num->aspects.front()->tk->type_name != "<integer>" ) {
+    auto num = app->aspects[2].tk->aspects.front().tk->aspects.front().tk.get();
+    if ( num->aspects.front().tk->kind != NK::INTEGER ) {
       throw std::string( "Index must be integer" );
     }
 
     long arg_val = 0;
     try {
       //               <number>            <integer>            val
-      arg_val = std::stol( num->aspects.front()->tk->aspects.front()->str );
+      arg_val = integer_value( num->aspects.front().tk.get() );
     } catch ( ... ) {
       throw std::string( "Number error" );
     }
 
     // Grab element from list
-    //        <expression>          <application>       <expression>
-    auto arg_exp = node->aspects.front()->tk->aspects[2]->tk.get();
-    //          <expression>             <constant>            <list_def>
-    auto list_def = arg_exp->aspects.front()->tk->aspects.front()->tk.get();
-    //         <list_def>            <datum>
-    auto datum = list_def->aspects[2]->tk.get();
-    //          <datum>               <list>
-    auto list = datum->aspects.front()->tk.get();
+    //                     <expression>          <application>      <expression>
+    auto list_def = own_list_def( node->aspects.front().tk->aspects[1].tk );
+    auto list = own_list( list_def );
 
     // Find location to pop
     auto itr = list->aspects.begin();
-    long pos = 0, list_len = list->aspects.size() - 2;
+    long pos = 0, list_len = list->aspects.size();
     if ( arg_val >= 0 ) {
       pos = arg_val;
     } else {
@@ -290,51 +303,125 @@ namespace psil_exec {
     if ( pos < 0 || pos > list_len ) {
       throw std::string( "Index out of bounds" );
     }
-    std::advance( itr, pos+1 );
+    std::advance( itr, pos );
       
     list->aspects.erase( itr );
 
-    auto quote = std::move( node->aspects.front()->tk->aspects[2]->tk );
+    auto quote = std::move( node->aspects.front().tk->aspects[1].tk );
     node = std::move( quote );
   }
 
   void psil_is_null( token_ptr & node ) {
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::LIST ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::LIST ) {
       throw std::string( "list operation procedure argument must be list" );
     }
 
     //        <expression>          <application>       <expression>
-    auto arg_exp = node->aspects.front()->tk->aspects[2]->tk.get();
+    auto arg_exp = node->aspects.front().tk->aspects[1].tk.get();
     //          <expression>             <constant>            <list_def>
-    auto list_def = arg_exp->aspects.front()->tk->aspects.front()->tk.get();
+    auto list_def = arg_exp->aspects.front().tk->aspects.front().tk.get();
     //         <list_def>            <datum>
-    auto datum = list_def->aspects[2]->tk.get();
+    auto datum = list_def->aspects.front().tk.get();
     //          <datum>               <list>
-    auto list = datum->aspects.front()->tk.get();
+    auto list = datum->aspects.front().tk.get();
 
-    auto ret = make_boolean( list->aspects.size()-2 == 0 );
+    auto ret = make_boolean( list->aspects.size() == 0 );
 
     node = std::move( ret );
   }
 
   // =============== QUOTE =========================================
+  // PSIL language used to reparse quoted code, built once since
+  // building it compiles all of the grammar's regexes
+  static const std::unique_ptr<psil_parser::language_t> & quote_lang() {
+    static auto lang = psil_parser::make_psil_lang();
+    return lang;
+  }
+
+  static void close_code( token_ptr & exp );
+
+  // Whether a lambda inside the code binds name
+  static bool bound_inside( const std::vector<const psil_parser::token_t*> & formals,
+			    const std::string * name ) {
+    for ( auto args : formals ) {
+      for ( auto & formal : args->aspects ) {
+	//                <variable>      <identifier>
+	if ( formal.tk->aspects.front().tk->aspects.front().s == name ) { return true; }
+      }
+    }
+    return false;
+  }
+
+  // Replace arguments bound in frame with their values, owning the tokens on the way,
+  // variables bound by the lambdas in formals are left alone
+  static void write_args( token_ptr & tk, const psil_parser::token_t * frame,
+			  std::vector<const psil_parser::token_t*> & formals ) {
+    if ( tk->kind == NK::CONSTANT ) { return; }
+    if ( tk->kind == NK::EXPRESSION && tk->head == HK::NONE && tk->aspects.size() == 1 &&
+	 tk->aspects.front().elem_type == TE_Type::TOKEN &&
+	 tk->aspects.front().tk->kind == NK::VARIABLE ) {
+      //                   <variable>           <identifier>
+      auto & var = tk->aspects.front().tk->aspects.front().tk->aspects.front();
+      if ( var.elem_type != TE_Type::STRING || bound_inside( formals, var.s ) ) { return; }
+      auto arg = find_arg( frame, var.s );
+      if ( arg != nullptr ) {
+	tk = arg->share();
+	close_code( tk );
+      }
+      return;
+    }
+    tk.own();
+    bool lambda = tk->kind == NK::LAMBDA;
+    if ( lambda ) { formals.push_back( tk->aspects[0].tk.get() ); }
+    for ( auto & elem : tk->aspects ) {
+      if ( elem.elem_type == TE_Type::TOKEN && elem.tk->kind != NK::FRAME ) {
+	write_args( elem.tk, frame, formals );
+      }
+    }
+    if ( lambda ) { formals.pop_back(); }
+  }
+
+  static void write_args( token_ptr & tk, const psil_parser::token_t * frame ) {
+    std::vector<const psil_parser::token_t*> formals;
+    write_args( tk, frame, formals );
+  }
+
+  // === Write arguments of running frame into code given to to_quote
+  void write_frame( stack_ptr & s, token_ptr & code ) {
+    if ( s->env != nullptr ) { write_args( code, s->env.get() ); }
+  }
+
+  // Write the arguments a closure was made in into its body, so its code stands alone
+  static void close_code( token_ptr & exp ) {
+    if ( exp->aspects.size() != 1 || exp->aspects.front().elem_type != TE_Type::TOKEN ) { return; }
+    auto lambda = exp->aspects.front().tk.get();
+    if ( lambda->kind != NK::LAMBDA || lambda->vtype != VarType::PROC || lambda->aspects.size() < 3 ) {
+      return;
+    }
+    exp.own();
+    exp->aspects.front().tk.own();
+    auto closure = exp->aspects.front().tk.get();
+    write_args( closure->aspects[1].tk, closure->aspects[2].tk.get() );
+  }
+
   // Convert expressions into datums
   void psil_quote( stack_ptr & s, token_ptr & node ) { // TODO remove s
     
     // === Convert datum into code string ===
-    auto app = node->aspects.front()->tk.get();
-    if ( app->aspects[2]->tk->aspects.front()->elem_type == TE_Type::TOKEN &&
-	 app->aspects[2]->tk->aspects.front()->tk->type_name == "<variable>" ) {
+    auto app = node->aspects.front().tk.get();
+    if ( app->aspects[1].tk->aspects.front().elem_type == TE_Type::TOKEN &&
+	 app->aspects[1].tk->aspects.front().tk->kind == NK::VARIABLE ) {
       bool r = false;
       try {
-	exec_var( s, app->aspects[2]->tk, r );
+	exec_var( s, app->aspects[1].tk, r );
       } catch ( ... ) {
 	if ( r ) throw std::string( "ERROR" );
       }
     }
+    close_code( app->aspects[1].tk );
     //            <application>    arg <exp..>         element
-    auto arg_elem = app->aspects[2]->tk->aspects.front().get();
+    auto arg_elem = &app->aspects[1].tk->aspects.front();
     std::string datum_code = arg_elem->tk->to_code();
     // Quote expression
     datum_code = "(quote " + datum_code + ")";
@@ -342,8 +429,8 @@ namespace psil_exec {
     
     // === UNQUOTE ===
     try {
-      // Remake PSIL
-      auto lang = psil_parser::make_psil_lang();
+      // Reuse PSIL
+      auto & lang = quote_lang();
       // Parse code
       auto ast = psil_parser::parse( lang, datum_code );
       if ( !ast ) { throw 1; } // Error while parsing
@@ -354,10 +441,12 @@ namespace psil_exec {
       // === Run eval library to check for error ===
       bool e = psil_eval::check_node( ast.get() );
       if ( !e ) { throw 1; } // Error while evaluating
+      psil_eval::lower_node( ast.get() );
+      psil_eval::pool_literals( ast, s->literals );
       
       // === Take result and update AST ===
       //       <program>            <form>               <expression>
-      auto tmp = std::move( ast->aspects.front()->tk->aspects.front()->tk );
+      auto tmp = std::move( ast->aspects.front().tk->aspects.front().tk );
       node = std::move( tmp );
     } catch ( ... ) {
       throw std::string( "Error while unquoting" );
@@ -367,17 +456,17 @@ namespace psil_exec {
   // Convert datums into expressions
   void psil_unquote( stack_ptr & s, token_ptr & node ) {
     // === Verify argument is correct type ===
-    auto app = node->aspects.front()->tk.get();
-    auto arg_elem = app->aspects[2]->tk->aspects.front().get();
+    auto app = node->aspects.front().tk.get();
+    auto arg_elem = &app->aspects[1].tk->aspects.front();
     if ( arg_elem->elem_type != TE_Type::TOKEN ||
-	 arg_elem->tk->type_name != "<constant>" ||
-	 arg_elem->tk->aspects.front()->tk->type_name != "<list_def>" ) {
+	 arg_elem->tk->kind != NK::CONSTANT ||
+	 arg_elem->tk->aspects.front().tk->kind != NK::LIST_DEF ) {
       throw std::string( "unquote argument must be quoted" );
     }
 
     // === Convert datum into code string ===
-    auto qt_arg = arg_elem->tk->aspects.front()->tk.get();
-    std::string datum_code = qt_arg->aspects[2]->tk->to_code();
+    auto qt_arg = arg_elem->tk->aspects.front().tk.get();
+    std::string datum_code = qt_arg->aspects.front().tk->to_code();
     // Place code within application to make sure resulting AST
     //  is an expression
     datum_code = "(" + datum_code + ")";
@@ -385,8 +474,8 @@ namespace psil_exec {
 
     // === UNQUOTE ===
     try {
-      // Remake PSIL
-      auto lang = psil_parser::make_psil_lang();
+      // Reuse PSIL
+      auto & lang = quote_lang();
       // Parse code
       auto ast = psil_parser::parse( lang, datum_code );
       if ( !ast ) { throw 1; } // Error while parsing
@@ -397,21 +486,20 @@ namespace psil_exec {
       // === Run eval library to check for error ===
       bool e = psil_eval::check_node( ast.get() );
       if ( !e ) { throw 1; } // Error while evaluating
+      psil_eval::lower_node( ast.get() );
+      psil_eval::pool_literals( ast, s->literals );
       
       // === Take result and update eAST ===
       //       <program>            <form>               <expression>
-      auto tmp = ast->aspects.front()->tk->aspects.front()->tk.get();
+      auto tmp = ast->aspects.front().tk->aspects.front().tk.get();
       //               <expression>         <application>
-      auto ret = std::move( tmp->aspects.front()->tk );
+      auto ret = std::move( tmp->aspects.front().tk );
       // Place result into begin statement
       node->aspects.clear();
-      node->aspects.push_back( std::make_unique<psil_parser::token_elem_t>( "(" ) );
-      node->aspects.push_back( std::make_unique<psil_parser::token_elem_t>( "begin" ) );
+      node->head = HK::BEGIN;
       for ( auto itr = ret->aspects.begin(); itr != ret->aspects.end(); ++itr ) {
-	if ( (*itr)->elem_type == TE_Type::TOKEN )
-	  node->aspects.push_back( std::move( *itr ) );
+	node->aspects.push_back( std::move( *itr ) );
       }
-      node->aspects.push_back( std::make_unique<psil_parser::token_elem_t>( ")" ) );
     } catch ( ... ) {
       throw std::string( "Error while unquoting" );
     }
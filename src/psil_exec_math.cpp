@@ -12,37 +12,92 @@
 namespace psil_exec {
 
   // === Helpers ===
-  token_ptr make_number( std::string val, bool int_or_dec ) {
+  // Integers below this are made once and shared
+  static const long long SMALL_INTS = 256;
+
+  // Build a number constant expression holding the value of num
+  static token_ptr build_number( NK num_type, psil_parser::number_t num ) {
     // Make expression
-    auto tmp_exp = std::make_unique<psil_parser::token_t>( "<expression>" );
+    auto tmp_exp = psil_parser::make_token( NK::EXPRESSION );
     // Make constant
-    auto tmp_con = std::make_unique<psil_parser::token_t>( "<constant>" );
+    auto tmp_con = psil_parser::make_token( NK::CONSTANT );
+    tmp_con->vtype = VarType::NUM;
     // Make number
-    auto tmp_num = std::make_unique<psil_parser::token_t>( "<number>" );
-    // Make int/dec
-    std::string num_type = "<integer>";
-    if ( !int_or_dec ) num_type = "<decimal>";
-    auto tmp_int_dec = std::make_unique<psil_parser::token_t>( num_type );
-    // Add val to integer
-    if ( int_or_dec ) {
-      try {
-	val = std::to_string( std::stoll( val ) );
-      } catch ( ... ) { std::string( "Conversion error" ); }
-    }
-    auto tmp_val = std::make_unique<psil_parser::token_elem_t>( val );
-    tmp_int_dec->aspects.push_back( std::move( tmp_val ) );
+    auto tmp_num = psil_parser::make_token( NK::NUMBER );
+    // Make int/dec, its text is written when it is needed
+    auto tmp_int_dec = psil_parser::make_token( num_type );
+    tmp_int_dec->vtype = VarType::NUM;
+    tmp_int_dec->num = num;
     // Add integer to number
-    auto elem_int_dec = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_int_dec ) );
+    auto elem_int_dec = psil_parser::token_elem_t( std::move( tmp_int_dec ) );
     tmp_num->aspects.push_back( std::move( elem_int_dec ) );
     // Add number to const
-    auto elem_num = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_num ) );
+    auto elem_num = psil_parser::token_elem_t( std::move( tmp_num ) );
     tmp_con->aspects.push_back( std::move( elem_num ) );
     // Add const to expression
-    auto elem_con = std::make_unique<psil_parser::token_elem_t>( std::move( tmp_con ) );
+    auto elem_con = psil_parser::token_elem_t( std::move( tmp_con ) );
     tmp_exp->aspects.push_back( std::move( elem_con ) );
     
     return tmp_exp;
   }
+
+  // Return integer constant expression, small integers are shared
+  token_ptr make_integer( long long val ) {
+    psil_parser::number_t num;
+    if ( val >= 0 && val < SMALL_INTS ) {
+      static token_ptr * values = nullptr; // never freed, outlives every arena
+      if ( values == nullptr ) {
+	psil_parser::arena_t::use_t perm( psil_parser::arena_t::permanent() );
+	values = new token_ptr[SMALL_INTS];
+	for ( long long i = 0; i < SMALL_INTS; ++i ) {
+	  num.i = i;
+	  values[i] = build_number( NK::INTEGER, num );
+	  // Write text now, so it is never added to a shared token later
+	  //       <expression>          <constant>            <number>            <integer>
+	  psil_parser::write_number( values[i]->aspects.front().tk->aspects.front().tk->aspects.front().tk.get() );
+	}
+      }
+      return values[val].share();
+    }
+    num.i = val;
+    return build_number( NK::INTEGER, num );
+  }
+
+  // Return decimal constant expression
+  token_ptr make_decimal( long double val ) {
+    psil_parser::number_t num;
+    num.d = val;
+    return build_number( NK::DECIMAL, num );
+  }
+
+  // Value of <integer>
+  long long integer_value( psil_parser::token_t * num ) {
+    if ( num->kind != NK::INTEGER || num->vtype == VarType::ERROR ) {
+      throw std::string( "Number error" );
+    }
+    return num->num.i;
+  }
+
+  // Value of <integer> or <decimal> as a long double
+  long double decimal_value( psil_parser::token_t * num ) {
+    if ( num->vtype == VarType::ERROR ) {
+      if ( num->kind == NK::INTEGER ) { // too large for an integer, not for a decimal
+	try {
+	  return std::stold( psil_parser::write_number( num ) );
+	} catch ( ... ) {}
+      }
+      throw std::string( "Number error" );
+    }
+    return ( num->kind == NK::INTEGER ) ? static_cast<long double>( num->num.i ) : num->num.d;
+  }
+
+  // Whole part of <integer> or <decimal>
+  static long long whole_value( psil_parser::token_t * num ) {
+    if ( num->kind == NK::INTEGER ) { return integer_value( num ); }
+    long double val = decimal_value( num );
+    if ( !( val > -9.2e18L && val < 9.2e18L ) ) { throw std::string( "Number error" ); }
+    return static_cast<long long>( val );
+  }
   
   // ==================================== MATH ========================================================
   // Operators
@@ -53,23 +108,23 @@ namespace psil_exec {
     long long int_total = 0; 
     long double dec_total = 0.0;
     //      <expression>        <application>
-    auto itr = node->aspects.front()->tk->aspects.begin();
-    for ( ; itr != node->aspects.front()->tk->aspects.end(); ++itr, ++idx ) {
-      if ( idx > 1 && idx < node->aspects.front()->tk->aspects.size() - 1 ) { // Just arguments of function
-	if ( (*itr)->tk->aspects.front()->tk->type_name != "<constant>" ||
-	     (*itr)->tk->aspects.front()->tk->aspects.front()->tk->type_name != "<number>" ) {
+    auto itr = node->aspects.front().tk->aspects.begin();
+    for ( ; itr != node->aspects.front().tk->aspects.end(); ++itr, ++idx ) {
+      if ( idx > 0 ) { // Just arguments of function
+	if ( itr->tk->aspects.front().tk->kind != NK::CONSTANT ||
+	     itr->tk->aspects.front().tk->aspects.front().tk->kind != NK::NUMBER ) {
 	  throw std::string( "Operation expects numbers" );
 	}
 	
 	//        <expression>               <constant>           <number>
-	auto num = (*itr)->tk->aspects.front()->tk->aspects.front()->tk.get();
-	std::string num_type = num->aspects.front()->tk->type_name;
-	if ( num_type == "<integer>" ) {
+	auto num = itr->tk->aspects.front().tk->aspects.front().tk.get();
+	NK num_type = num->aspects.front().tk->kind;
+	if ( num_type == NK::INTEGER ) {
 	  if ( int_or_dec == 0 || int_or_dec == 1 ) {
 	    int_or_dec = 1;
 	    long long tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stoll(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = integer_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -77,7 +132,7 @@ namespace psil_exec {
 	  } else { // Add to dec
 	    long double tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = decimal_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -89,8 +144,8 @@ namespace psil_exec {
 	    int_or_dec = 2;
 	    long double tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
-	      tmp += std::stold( std::to_string( int_total ) ); // TODO
+	      tmp = decimal_value( num->aspects.front().tk.get() );
+	      tmp += static_cast<long double>( int_total );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -98,7 +153,7 @@ namespace psil_exec {
 	  } else { // Keep using dec
 	    long double tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = decimal_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -109,8 +164,7 @@ namespace psil_exec {
     }
     
     if ( int_or_dec == 0 ) throw std::string( "Argument error" );
-    std::string val = ( int_or_dec == 1 ) ? std::to_string( int_total ) : std::to_string( dec_total );
-    auto number = make_number( val, int_or_dec == 1 );
+    auto number = ( int_or_dec == 1 ) ? make_integer( int_total ) : make_decimal( dec_total );
     node = std::move( number );
   }
   
@@ -121,22 +175,22 @@ namespace psil_exec {
     long long int_total = 0; 
     long double dec_total = 0.0;
     //      <expression>        <application>
-    auto itr = node->aspects.front()->tk->aspects.begin();
-    for ( ; itr != node->aspects.front()->tk->aspects.end(); ++itr, ++idx ) {
-      if ( idx > 1 && idx < node->aspects.front()->tk->aspects.size() - 1 ) { // Just arguments of function
-	if ( (*itr)->tk->aspects.front()->tk->type_name != "<constant>" ||
-	     (*itr)->tk->aspects.front()->tk->aspects.front()->tk->type_name != "<number>" ) {
+    auto itr = node->aspects.front().tk->aspects.begin();
+    for ( ; itr != node->aspects.front().tk->aspects.end(); ++itr, ++idx ) {
+      if ( idx > 0 ) { // Just arguments of function
+	if ( itr->tk->aspects.front().tk->kind != NK::CONSTANT ||
+	     itr->tk->aspects.front().tk->aspects.front().tk->kind != NK::NUMBER ) {
 	  throw std::string( "Operation expects numbers" );
 	}
 	
 	//        <expression>               <constant>           <number>
-	auto num = (*itr)->tk->aspects.front()->tk->aspects.front()->tk.get();
-	std::string num_type = num->aspects.front()->tk->type_name;
-	if ( num_type == "<integer>" ) {
+	auto num = itr->tk->aspects.front().tk->aspects.front().tk.get();
+	NK num_type = num->aspects.front().tk->kind;
+	if ( num_type == NK::INTEGER ) {
 	  if ( int_or_dec == 0 || int_or_dec == 1 ) {
 	    long long tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stoll(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = integer_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -149,7 +203,7 @@ namespace psil_exec {
 	  } else { // Add to dec
 	    long double tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = decimal_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -161,10 +215,10 @@ namespace psil_exec {
 	    long double tmp = 0;
 	    try { // Convert string to long long
 	      if ( int_or_dec == 0 ) {
-		tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
+		tmp = decimal_value( num->aspects.front().tk.get() );
 	      } else {
-		tmp = std::stold( std::to_string( int_total ) ); // TODO
-		tmp -= std::stold(num->aspects.front()->tk->aspects.front()->str);
+		tmp = static_cast<long double>( int_total );
+		tmp -= decimal_value( num->aspects.front().tk.get() );
 	      }
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
@@ -174,7 +228,7 @@ namespace psil_exec {
 	  } else { // Keep using dec
 	    long double tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = decimal_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -185,8 +239,7 @@ namespace psil_exec {
     }
     
     if ( int_or_dec == 0 ) throw std::string( "Argument error" );
-    std::string val = ( int_or_dec == 1 ) ? std::to_string( int_total ) : std::to_string( dec_total );
-    auto number = make_number( val, int_or_dec == 1 );
+    auto number = ( int_or_dec == 1 ) ? make_integer( int_total ) : make_decimal( dec_total );
     node = std::move( number );
   }
   // Multiplication of all the numerical arguments
@@ -196,23 +249,23 @@ namespace psil_exec {
     long long int_total = 1; 
     long double dec_total = 1.0;
     //      <expression>        <application>
-    auto itr = node->aspects.front()->tk->aspects.begin();
-    for ( ; itr != node->aspects.front()->tk->aspects.end(); ++itr, ++idx ) {
-      if ( idx > 1 && idx < node->aspects.front()->tk->aspects.size() - 1 ) { // Just arguments of function
-	if ( (*itr)->tk->aspects.front()->tk->type_name != "<constant>" ||
-	     (*itr)->tk->aspects.front()->tk->aspects.front()->tk->type_name != "<number>" ) {
+    auto itr = node->aspects.front().tk->aspects.begin();
+    for ( ; itr != node->aspects.front().tk->aspects.end(); ++itr, ++idx ) {
+      if ( idx > 0 ) { // Just arguments of function
+	if ( itr->tk->aspects.front().tk->kind != NK::CONSTANT ||
+	     itr->tk->aspects.front().tk->aspects.front().tk->kind != NK::NUMBER ) {
 	  throw std::string( "Operation expects numbers" );
 	}
 	
 	//        <expression>               <constant>           <number>
-	auto num = (*itr)->tk->aspects.front()->tk->aspects.front()->tk.get();
-	std::string num_type = num->aspects.front()->tk->type_name;
-	if ( num_type == "<integer>" ) {
+	auto num = itr->tk->aspects.front().tk->aspects.front().tk.get();
+	NK num_type = num->aspects.front().tk->kind;
+	if ( num_type == NK::INTEGER ) {
 	  if ( int_or_dec == 0 || int_or_dec == 1 ) {
 	    int_or_dec = 1;
 	    long long tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stoll(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = integer_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -220,7 +273,7 @@ namespace psil_exec {
 	  } else { // Add to dec
 	    long double tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = decimal_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -232,8 +285,8 @@ namespace psil_exec {
 	    int_or_dec = 2;
 	    long double tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
-	      tmp *= std::stold( std::to_string( int_total ) ); // TODO
+	      tmp = decimal_value( num->aspects.front().tk.get() );
+	      tmp *= static_cast<long double>( int_total );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -241,7 +294,7 @@ namespace psil_exec {
 	  } else { // Keep using dec
 	    long double tmp = 0;
 	    try { // Convert string to long long
-	      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
+	      tmp = decimal_value( num->aspects.front().tk.get() );
 	    } catch ( ... ) {
 	      throw std::string( "Number error" );
 	    }
@@ -251,8 +304,7 @@ namespace psil_exec {
       }
     }
     if ( int_or_dec == 0 ) throw std::string( "Argument error" );
-    std::string val = ( int_or_dec == 1 ) ? std::to_string( int_total ) : std::to_string( dec_total );
-    auto number = make_number( val, int_or_dec == 1 );
+    auto number = ( int_or_dec == 1 ) ? make_integer( int_total ) : make_decimal( dec_total );
     node = std::move( number );
   }
   
@@ -262,20 +314,19 @@ namespace psil_exec {
     bool first = true;
     long double dec_total = 0.0;
     //      <expression>        <application>
-    auto itr = node->aspects.front()->tk->aspects.begin();
-    for ( ; itr != node->aspects.front()->tk->aspects.end(); ++itr, ++idx ) {
-      if ( idx > 1 && idx < node->aspects.front()->tk->aspects.size() - 1 ) { // Just arguments of function
-	if ( (*itr)->tk->aspects.front()->tk->type_name != "<constant>" ||
-	     (*itr)->tk->aspects.front()->tk->aspects.front()->tk->type_name != "<number>" ) {
+    auto itr = node->aspects.front().tk->aspects.begin();
+    for ( ; itr != node->aspects.front().tk->aspects.end(); ++itr, ++idx ) {
+      if ( idx > 0 ) { // Just arguments of function
+	if ( itr->tk->aspects.front().tk->kind != NK::CONSTANT ||
+	     itr->tk->aspects.front().tk->aspects.front().tk->kind != NK::NUMBER ) {
 	  throw std::string( "Operation expects numbers" );
 	}
 	
 	//        <expression>               <constant>           <number>
-	auto num = (*itr)->tk->aspects.front()->tk->aspects.front()->tk.get();
-	std::string num_type = num->aspects.front()->tk->type_name;
+	auto num = itr->tk->aspects.front().tk->aspects.front().tk.get();
 	long double tmp = 0;
 	try { // Convert string to long long
-	  tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
+	  tmp = decimal_value( num->aspects.front().tk.get() );
 	} catch ( ... ) {
 	  throw std::string( "Number error" );
 	}
@@ -289,27 +340,27 @@ namespace psil_exec {
     }
     
     if ( first ) { throw std::string( "Math error" ); }
-    std::string val = std::to_string( dec_total );
-    auto number = make_number( val, false );
+    auto number = make_decimal( dec_total );
     node = std::move( number );
   }
 
 
   void psil_round( token_ptr & node, std::function<long double(long double)> op ) {
     // Verify argument is number
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::NUM ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::NUM ) {
       throw std::string( "rounding procedure argument must be number" );
     }
 
     // Get number
     //          <expression>             <constant>            <number>
-    auto num = app->aspects[2]->tk->aspects.front()->tk->aspects.front()->tk.get();
+    auto num = app->aspects[1].tk->aspects.front().tk->aspects.front().tk.get();
     long double tmp = 0;
     try {
       //             <number>              <int/dec>           value
-      tmp = std::stold(num->aspects.front()->tk->aspects.front()->str);
-      auto number = make_number( std::to_string( op( tmp )), true );
+      tmp = op( decimal_value( num->aspects.front().tk.get() ) );
+      if ( !( tmp > -9.2e18L && tmp < 9.2e18L ) ) { throw std::string( "Number error" ); }
+      auto number = make_integer( static_cast<long long>( tmp ) );
       node = std::move( number );
     } catch ( ... ) {
       throw std::string( "Number error" );
@@ -320,22 +371,24 @@ namespace psil_exec {
   // Finds the first argument mod the second argument
   void psil_mod( token_ptr & node ) {
     // Verify argument is number
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::NUM ||
-	 check_type( app->aspects[3]->tk ) != VarType::NUM ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::NUM ||
+	 check_type( app->aspects[2].tk ) != VarType::NUM ) {
       throw std::string( "mod procedure arguments must be number" );
     }
 
     // Get number
     //          <expression>             <constant>            <number>
-    auto num1 = app->aspects[2]->tk->aspects.front()->tk->aspects.front()->tk.get();
-    auto num2 = app->aspects[3]->tk->aspects.front()->tk->aspects.front()->tk.get();
+    auto num1 = app->aspects[1].tk->aspects.front().tk->aspects.front().tk.get();
+    auto num2 = app->aspects[2].tk->aspects.front().tk->aspects.front().tk.get();
     long double arg1 = 0, arg2 = 0;
     try {
       //             <number>              <int/dec>           value
-      arg1 = std::stoll(num1->aspects.front()->tk->aspects.front()->str);
-      arg2 = std::stoll(num2->aspects.front()->tk->aspects.front()->str);
-      auto number = make_number( std::to_string( remainder( arg1,  arg2 ) ), true );
+      arg1 = whole_value( num1->aspects.front().tk.get() );
+      arg2 = whole_value( num2->aspects.front().tk.get() );
+      long double ret = remainder( arg1, arg2 );
+      if ( std::isnan( ret ) ) { throw std::string( "Number error" ); }
+      auto number = make_integer( static_cast<long long>( ret ) );
       node = std::move( number );
     } catch ( ... ) {
       throw std::string( "Number error" );
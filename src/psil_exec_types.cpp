@@ -14,8 +14,8 @@ namespace psil_exec {
 
   // === If the node contains the type t, return true, else false
   void psil_type_check( token_ptr & node, VarType t ) {
-    auto app = node->aspects.front()->tk.get();
-    bool is_type = check_type( app->aspects[2]->tk ) == t;
+    auto app = node->aspects.front().tk.get();
+    bool is_type = check_type( app->aspects[1].tk ) == t;
     auto ret = make_boolean( is_type );
     node = std::move( ret );
   }
@@ -23,16 +23,16 @@ namespace psil_exec {
 
   // === If the node contains the type of number signified by int_or_dec return true
   void psil_num_check( token_ptr & node, bool int_or_dec ) {
-    auto app = node->aspects.front()->tk.get();
-    if ( check_type( app->aspects[2]->tk ) != VarType::NUM ) {
+    auto app = node->aspects.front().tk.get();
+    if ( check_type( app->aspects[1].tk ) != VarType::NUM ) {
       throw std::string( "Number type check must be a number" );
     }
 
     //       <application>     <expression>        <constant>         <number>
-    auto num = app->aspects[2]->tk->aspects.front()->tk->aspects.front()->tk.get();
+    auto num = app->aspects[1].tk->aspects.front().tk->aspects.front().tk.get();
     bool is_num_type;
-    if ( int_or_dec ) is_num_type = num->aspects.front()->tk->type_name == "<integer>";
-    else is_num_type = num->aspects.front()->tk->type_name == "<decimal>";
+    if ( int_or_dec ) is_num_type = num->aspects.front().tk->kind == NK::INTEGER;
+    else is_num_type = num->aspects.front().tk->kind == NK::DECIMAL;
     
     auto ret = make_boolean( is_num_type );
     node = std::move( ret );
@@ -8,6 +8,8 @@
 
 
 #include "psil_parser.h"
+#include <cstring>
+#include <deque>
 
 
 namespace psil_parser {
@@ -17,23 +19,144 @@ namespace psil_parser {
   
   // ========== Token ==================================================
   
+  // ========== Node Kinds ==========================================
+
+  // Interned type names, the fixed kinds come first in order of node_kind
+  struct kind_table_t {
+    kind_table_t() {
+      for ( auto n : { "<program>", "<form>", "<definition>", "<variable>", "<expression>",
+		       "<constant>", "<lambda>", "<formals>", "<body>", "<conditional>",
+		       "<application>", "<identifier>", "<operator>", "<keyword>", "<list_def>",
+		       "<datum>", "<boolean>", "<character>", "<symbol>", "<list>", "<number>",
+		       "<integer>", "<decimal>", "<frame>" } ) {
+	intern( n );
+      }
+    }
+
+    node_kind intern( std::string_view name ) {
+      auto itr = kinds.find( name );
+      if ( itr != kinds.end() ) { return itr->second; }
+      node_kind k = static_cast<node_kind>( names.size() );
+      names.push_back( std::string( name ) );
+      kinds.insert( std::make_pair( names.back(), k ) );
+      return k;
+    }
+
+    std::vector<std::string> names;
+    std::map<std::string, node_kind, std::less<> > kinds;
+  };
+
+  static kind_table_t & kind_table() {
+    static kind_table_t table;
+    return table;
+  }
+
+  // === Find or add kind of type name
+  node_kind intern_kind( std::string_view name ) {
+    return kind_table().intern( name );
+  }
+
+  // === Type name of kind
+  const std::string & kind_name( node_kind k ) {
+    return kind_table().names[ static_cast<size_t>( k ) ];
+  }
+
+  // === Keyword of head
+  const std::string & head_name( head_kind h ) {
+    static const std::string names[] = { "", "", "begin", "define", "update",
+					 "lambda", "cond", "if", "quote" };
+    return names[ static_cast<size_t>( h ) ];
+  }
+
+  // ========== Interned Strings ====================================
+
+  // === Find or add interned copy of string, only a new string is copied
+  const std::string * intern_str( std::string_view s ) {
+    static std::deque<std::string> strings; // never moved, the index views into them
+    static std::unordered_map<std::string_view, const std::string *> index;
+    auto itr = index.find( s );
+    if ( itr != index.end() ) { return itr->second; }
+    const std::string * str = &strings.emplace_back( s );
+    index.emplace( *str, str );
+    return str;
+  }
+
+  // === Lets go of children with a worklist, so deep trees cannot overflow the stack
+  token_t::~token_t() {
+    if ( aspects.empty() ) { return; }
+    if ( arena_t::owner( this, sizeof(token_t) ).is_dropping() ) { // arena frees everything at once
+      for ( auto & elem : aspects ) { elem.tk.release(); }
+      return;
+    }
+    small_vec<token_t*, 16> work;
+    auto detach = [&work]( token_t * t ) {
+		    for ( auto & elem : t->aspects ) {
+		      if ( elem.tk ) { work.emplace_back( elem.tk.release() ); }
+		    }
+		  };
+    detach( this );
+    while ( !work.empty() ) {
+      token_t * t = work.back();
+      work.pop_back();
+      if ( --t->refs > 0 ) { continue; } // still held elsewhere
+      detach( t );
+      delete t;
+    }
+  }
+
+  // === Copy shared token for this pointer alone, children are shared with the old token
+  void token_ptr::own() {
+    if ( !shared() ) { return; }
+    token_t * t = new token_t( p->kind, p->head );
+    t->vtype = p->vtype;
+    t->depth = p->depth;
+    t->slot = p->slot;
+    t->num = p->num;
+    t->aspects.reserve( p->aspects.size() );
+    for ( auto & elem : p->aspects ) {
+      if ( elem.elem_type == token_elem_t::TE_Type::TOKEN ) {
+	t->aspects.emplace_back( elem.tk.share() );
+      } else {
+	t->add_str( elem );
+      }
+    }
+    reset( t );
+  }
+
+  // === Numbers are not names, so their text is freed with the token instead of interned
+  void token_t::add_leaf( std::string_view t ) {
+    if ( kind == node_kind::INTEGER || kind == node_kind::DECIMAL ) {
+      aspects.emplace_back( arena_t::owner( this, sizeof( token_t ) ), t );
+    } else {
+      aspects.emplace_back( t );
+    }
+  }
+
+  void token_t::add_str( const token_elem_t & elem ) {
+    if ( elem.owned ) {
+      aspects.emplace_back( arena_t::owner( this, sizeof( token_t ) ), elem.str() );
+    } else {
+      aspects.emplace_back( elem.s );
+    }
+  }
+
   // === Prints token with breadth-first search
   void token_t::print() {
     std::cout << std::endl;
     std::vector<const token_elem_t * > current;
     std::vector<const token_elem_t * > next;
 
-    //const token_elem_t * tmp = new token_elem_t( this );
-    current.push_back( new token_elem_t( this ) );
+    std::cout << "  Tk:type: " << type_name() << std::endl;
+    for ( auto & elem : aspects ) { current.push_back( &elem ); }
   
     while ( current.size() > 0 ) {
       for ( auto elem : current ) {
 	if ( elem->elem_type == token_elem_t::TE_Type::STRING) { // string
-	  std::cout << "  Aspect:: " << elem->str;
+	  std::cout << "  Aspect:: " << elem->str();
 	} else { // token
-	  std::cout << "  Tk:type: " << elem->tk->type_name;
+	  std::cout << "  Tk:type: " << elem->tk->type_name();
 	  for ( auto it = elem->tk->aspects.begin(); it != elem->tk->aspects.end(); ++it ) {
-	    next.push_back( it->get() );
+	    next.push_back( it );
 	  }
 	}
       }
@@ -47,20 +170,78 @@ namespace psil_parser {
   // === Turns token back into code
   std::string token_t::to_code() {
     std::string ret = "";
+    if ( kind == node_kind::INTEGER || kind == node_kind::DECIMAL ) { write_number( this ); }
+    if ( head != head_kind::NONE ) { // Lowered, put punctuation back
+      ret += "( ";
+      if ( head != head_kind::PAREN ) { ret += head_name( head ) + " "; }
+    }
     for ( auto itr = this->aspects.begin(); itr != this->aspects.end(); ++itr ) {
-      if ( (*itr)->elem_type == token_elem_t::TE_Type::STRING ) { // String
-	ret += (*itr)->str + " ";
-      } else { // TOKEN
-	ret += (*itr)->tk->to_code();
+      if ( itr->elem_type == token_elem_t::TE_Type::STRING ) { // String
+	ret += itr->str() + " ";
+      } else if ( itr->tk->kind != node_kind::FRAME ) { // TOKEN, environment of closure is not code
+	ret += itr->tk->to_code();
       }
     }
+    if ( head != head_kind::NONE ) { ret += ") "; }
     return ret;
   }
 
+  // === Binary value of number from its text
+  void read_number( token_t * tk ) {
+    tk->vtype = VarType::ERROR;
+    if ( tk->aspects.size() != 1 || tk->aspects.front().elem_type != token_elem_t::TE_Type::STRING ) {
+      return;
+    }
+    try {
+      if ( tk->kind == node_kind::INTEGER ) {
+	tk->num.i = std::stoll( tk->aspects.front().str() );
+      } else {
+	tk->num.d = std::stold( tk->aspects.front().str() );
+      }
+      tk->vtype = VarType::NUM;
+    } catch ( ... ) {} // out of range, left as ERROR
+  }
+
+  // === Text of number, made from its binary value the first time it is needed
+  const std::string & write_number( token_t * tk ) {
+    if ( tk->aspects.empty() ) {
+      if ( tk->kind == node_kind::INTEGER ) {
+	tk->add_leaf( std::to_string( tk->num.i ) );
+      } else {
+	tk->add_leaf( std::to_string( tk->num.d ) );
+      }
+    }
+    return tk->aspects.front().str();
+  }
+
+  // === Compare numbers by value, text is only known for numbers that did not fit
+  bool same_number( const token_t * a, const token_t * b ) {
+    if ( a->kind != b->kind ) { return false; }
+    if ( a->vtype != VarType::NUM || b->vtype != VarType::NUM ) {
+      return a->vtype == b->vtype && !a->aspects.empty() && !b->aspects.empty() &&
+	a->aspects.front().str() == b->aspects.front().str();
+    }
+    return ( a->kind == node_kind::INTEGER ) ? a->num.i == b->num.i : a->num.d == b->num.d;
+  }
+
+  // === Hash binary value of number, decimals are hashed as double since long double has padding
+  uint64_t hash_number( const token_t * tk ) {
+    if ( tk->vtype != VarType::NUM ) {
+      return tk->aspects.empty() ? 0 : std::hash<std::string>()( tk->aspects.front().str() );
+    }
+    if ( tk->kind == node_kind::INTEGER ) { return static_cast<uint64_t>( tk->num.i ); }
+    double d = static_cast<double>( tk->num.d );
+    if ( d == 0 ) { return 0; } // 0.0 and -0.0 are equal
+    uint64_t bits;
+    std::memcpy( &bits, &d, sizeof( bits ) );
+    return bits;
+  }
+
   // ========== Parser =================================================
 
-  // === Constructs parser and tokenize rules
-  parser_t::parser_t( std::string n, std::string rs ) :  name(n) {
+  // === Constructs parser, tokenize rules and compile their regexes
+  parser_t::parser_t( std::string n, std::string rs ) :  name(n), kind( intern_kind( n ) ), literal_lookup(nullptr),
+							     first_any(0), second_any(0) {
     // split rule list into parts
     std::string rule;
     size_t loc;
@@ -82,6 +263,14 @@ namespace psil_parser {
       str_vec rvec = tokenize_rule( rs );
       rules.push_back( rvec );
     }
+    // Compile regexes once, match_rule reuses them for every token
+    for ( auto & rule : rules ) {
+      std::vector<std::unique_ptr<std::regex> > rule_res;
+      for ( auto & elem : rule ) {
+	rule_res.push_back( is_regex( elem ) ? compile_regex( elem ) : nullptr );
+      }
+      regexes.push_back( std::move( rule_res ) );
+    }
   }
 
 
@@ -125,6 +314,8 @@ namespace psil_parser {
     if ( !ret.second ) { // Did not insert
       throw std::string( "Error: Parser of same name already in language" );
     }
+    bind_classes( p );
+    compiled = false;
     std::unique_ptr<lang_elem_t> elem( new lang_elem_t( p ) );
     this->items.push_back( std::move(elem) );
     return p;
@@ -136,6 +327,8 @@ namespace psil_parser {
     if ( !ret.second ) { // Did not insert
       throw std::string( "Error: Parser of same name already in language" );
     }
+    bind_classes( p );
+    compiled = false;
     std::unique_ptr<lang_elem_t> elem( new lang_elem_t( p ) );
     g->items.push_back( std::move(elem) );
     return p;
@@ -148,14 +341,185 @@ namespace psil_parser {
     return g_down;
   }
 
+  // Register the token kind of tokens matched by a {regex} rule element
+  void language_t::add_token_class( std::string regex, tok_kind k ) {
+    token_classes[regex] = k;
+    for ( auto & elem : all_parsers ) {
+      bind_classes( elem.second.get() );
+    }
+  }
+
+  // Bind the parser's {regex} rule elements to registered token kinds
+  void language_t::bind_classes( parser_t * p ) const {
+    p->classes.clear();
+    for ( auto & rule : p->rules ) {
+      std::vector<tok_kind> rule_classes;
+      for ( auto & elem : rule ) {
+	auto itr = token_classes.find( elem );
+	rule_classes.push_back( itr != token_classes.end() ? itr->second : tok_kind::NONE );
+      }
+      p->classes.push_back( std::move( rule_classes ) );
+    }
+  }
+
+  // ========== Predictive Tables ===================================
+
+  // Set of terminals that can start a rule element, any means every token
+  struct term_set_t {
+    std::set<int> ids;
+    bool any = false;
+
+    bool add( const term_set_t & o ) {
+      size_t old = ids.size();
+      bool old_any = any;
+      ids.insert( o.ids.begin(), o.ids.end() );
+      any = any || o.any;
+      return ids.size() != old || any != old_any;
+    }
+  };
+
+  // FIRST, FIRST after an open paren and nullable for each parser
+  struct first_sets_t {
+    std::map<const parser_t*, term_set_t> first, second;
+    std::map<const parser_t*, bool> nullable;
+  };
+
+  static bool is_open_paren( const std::string & elem ) { return elem == "(" || elem == "["; }
+
+  // Terminal id of a non rule element
+  static int terminal_of( const language_t & lang, const parser_t * p, size_t r, size_t i ) {
+    if ( p->regexes[r][i] ) {
+      tok_kind k = p->classes[r][i];
+      return ( k == tok_kind::NONE ) ? -1 : static_cast<int>( k );
+    }
+    return lang.terminals.find( p->rules[r][i] )->second;
+  }
+
+  // FIRST of rule elements from start, returns whether they can all be skipped
+  static bool first_of_seq( const language_t & lang, const first_sets_t & fs,
+			    const parser_t * p, size_t r, size_t start, term_set_t & out ) {
+    const str_vec & rule = p->rules[r];
+    for ( size_t i = start; i < rule.size(); ++i ) {
+      if ( is_rule( rule[i] ) ) {
+	const parser_t * next_p = lang.get_parser( rule[i] );
+	if ( next_p == nullptr ) { out.any = true; return false; }
+	out.add( fs.first.at( next_p ) );
+	if ( rule[i].back() != '*' && !fs.nullable.at( next_p ) ) { return false; }
+      } else {
+	int t = terminal_of( lang, p, r, i );
+	if ( t < 0 ) { out.any = true; } else { out.ids.insert( t ); }
+	return false;
+      }
+    }
+    return true;
+  }
+
+  // Terminals that can follow an open paren the rule elements start with
+  static void second_of_seq( const language_t & lang, const first_sets_t & fs,
+			     const parser_t * p, size_t r, size_t start, term_set_t & out ) {
+    const str_vec & rule = p->rules[r];
+    for ( size_t i = start; i < rule.size(); ++i ) {
+      if ( is_rule( rule[i] ) ) {
+	const parser_t * next_p = lang.get_parser( rule[i] );
+	if ( next_p == nullptr ) { out.any = true; return; }
+	out.add( fs.second.at( next_p ) );
+	if ( rule[i].back() != '*' && !fs.nullable.at( next_p ) ) { return; }
+      } else {
+	if ( is_open_paren( rule[i] ) ) {
+	  if ( first_of_seq( lang, fs, p, r, i+1, out ) ) { out.any = true; }
+	}
+	return;
+      }
+    }
+  }
+
+  // === Build predictive dispatch tables from FIRST sets of every rule
+  void language_t::compile_tables() {
+    // Number every word of the grammar after the token kinds
+    terminals.clear();
+    for ( auto & elem : all_parsers ) {
+      const parser_t * p = elem.second.get();
+      for ( size_t r = 0; r < p->rules.size(); ++r ) {
+	for ( size_t i = 0; i < p->rules[r].size(); ++i ) {
+	  const std::string & e = p->rules[r][i];
+	  if ( !is_rule( e ) && !p->regexes[r][i] && terminals.find( e ) == terminals.end() ) {
+	    int id = NUM_TOK_KINDS + terminals.size();
+	    terminals[e] = id;
+	  }
+	}
+      }
+    }
+    const size_t num_terms = NUM_TOK_KINDS + terminals.size();
+
+    // FIRST sets of every parser, repeated until nothing changes
+    first_sets_t fs;
+    for ( auto & elem : all_parsers ) {
+      fs.first[elem.second.get()];
+      fs.second[elem.second.get()];
+      fs.nullable[elem.second.get()] = false;
+    }
+    for ( bool changed = true; changed; ) {
+      changed = false;
+      for ( auto & elem : all_parsers ) {
+	const parser_t * p = elem.second.get();
+	for ( size_t r = 0; r < p->rules.size(); ++r ) {
+	  term_set_t f, sec;
+	  if ( first_of_seq( *this, fs, p, r, 0, f ) && !fs.nullable[p] ) {
+	    fs.nullable[p] = changed = true;
+	  }
+	  second_of_seq( *this, fs, p, r, 0, sec );
+	  changed = fs.first[p].add( f ) || changed;
+	  changed = fs.second[p].add( sec ) || changed;
+	}
+      }
+    }
+
+    // Fill bitmasks of each parser's rules
+    for ( auto & elem : all_parsers ) {
+      parser_t * p = elem.second.get();
+      p->subparsers.clear();
+      for ( auto & rule : p->rules ) {
+	std::vector<const parser_t *> rule_subs;
+	for ( auto & e : rule ) { rule_subs.push_back( is_rule( e ) ? get_parser( e ) : nullptr ); }
+	p->subparsers.push_back( std::move( rule_subs ) );
+      }
+      p->first.clear();
+      p->second.clear();
+      p->first_any = p->second_any = 0;
+      if ( p->rules.size() > 64 ) { continue; } // try every rule
+      p->first.assign( num_terms, 0 );
+      p->second.assign( num_terms, 0 );
+      for ( size_t r = 0; r < p->rules.size(); ++r ) {
+	uint64_t bit = uint64_t(1) << r;
+	term_set_t f, sec;
+	bool skip = first_of_seq( *this, fs, p, r, 0, f );
+	second_of_seq( *this, fs, p, r, 0, sec );
+	if ( skip || f.any ) { p->first_any |= bit; p->second_any |= bit; }
+	if ( sec.any ) { p->second_any |= bit; }
+	for ( int t : f.ids ) { p->first[t] |= bit; }
+	for ( int t : sec.ids ) { p->second[t] |= bit; }
+      }
+    }
+    compiled = true;
+  }
+
+  // === Give each token the terminal id of its word
+  void language_t::index_terminals( token_stream_t & ts ) const {
+    ts.terms.clear();
+    for ( auto tk : ts.tokens ) {
+      auto itr = terminals.find( tk );
+      ts.terms.push_back( itr != terminals.end() ? itr->second : -1 );
+    }
+  }
+
   /**
      Find parser by name inside language
      @param pn - name of parser
      @return parser pointer if found, nullptr if not
   */
-  parser_t * language_t::get_parser( std::string pn ) const {
+  parser_t * language_t::get_parser( std::string_view pn ) const {
     size_t len = pn.size();
-    std::string name = ( pn[len-1] == '+' || pn[len-1] == '*' ) ? pn.substr(0, pn.size()-1) : pn;
+    std::string_view name = ( pn[len-1] == '+' || pn[len-1] == '*' ) ? pn.substr(0, pn.size()-1) : pn;
     auto ret_itr = all_parsers.find( name );
     if ( ret_itr != all_parsers.end() ) {
       return ret_itr->second.get();
@@ -210,7 +574,7 @@ namespace psil_parser {
   // ========================== Helping functions =======================================================
 
   // === Checks whether input is a <rule> that can be expanded
-  bool is_rule( std::string input ) {
+  bool is_rule( const std::string & input ) {
     // Check for <...>
     if ( input.size() >= 3 ) {
       if ( input[0] == '<' && input[input.size()-1] == '>' ) {
@@ -229,7 +593,7 @@ namespace psil_parser {
   }
 
   // === Checks whether input is a {regex} expression
-  bool is_regex( std::string input ) {
+  bool is_regex( const std::string & input ) {
     // Check for {...}
     if ( input.size() >= 3 ) {
       if ( input[0] == '{' && input[input.size()-1] == '}' ) {
@@ -241,9 +605,23 @@ namespace psil_parser {
 
   // === Runs regex expression and returns whether it matches
   bool match_regex( std::string expression, std::string input ) {
+    return match_regex( *compile_regex( expression ), input );
+  }
+
+  // === Compiles {regex} expression
+  std::unique_ptr<std::regex> compile_regex( const std::string & expression ) {
     std::string expr = expression.substr(1,expression.size()-2);
-    std::regex re( expr );
-    return std::regex_match( input, re );
+    try {
+      return std::make_unique<std::regex>( expr, std::regex::optimize );
+    } catch ( std::regex_error & ) {
+      throw std::string( "Error: invalid regex " + expression );
+    }
+    return nullptr;
+  }
+
+  // === Runs compiled regex and returns whether it matches
+  bool match_regex( const std::regex & re, std::string_view input ) {
+    return std::regex_match( input.begin(), input.end(), re );
   }
 
   // === Verify entire string has matching parens
@@ -411,63 +789,180 @@ namespace psil_parser {
 
   // === Split input string into tokens
   std::vector<std::string> tokenize_input( std::string input ) {
-    std::vector<std::string> ret;
-    size_t loc = 0;
-  
-    for ( size_t i = 0; i < input.size(); ++i ) {
-      if ( input[i] == '('  ) { // OPEN PAREN
-	// find closing paren
-	auto mp_ret = match_parens( i, input );
-	if ( mp_ret.second.size() == 0 ) {
-	  auto tmp_vec = tokenize_input( input.substr( i+1, mp_ret.first-i-1) );
-	  ret.push_back(input.substr(i, 1));
-	  ret.insert( ret.end(), tmp_vec.begin(), tmp_vec.end() );
-	  ret.push_back(input.substr(mp_ret.first,1));
-	  i = mp_ret.first;
-	} else { // Error occurred
-	  std::cerr << "Error while parsing input\n";
-	  std::cerr << "Error: " << mp_ret.second;
-	  std::cerr << "Input: " << input << std::endl;
-	  ret.clear();
-	  return ret;
-	}
-      } else if ( input[i] != ' ' ) { // WHITESPACE
-	// find next space and tokenize
-	loc = i+1;
-	for ( ; loc < input.size(); ++loc ) {
-	  if ( input[loc] == ' ' || input[loc] == '('
-	       || input[loc] == '[' || input[loc] == ')' || input[loc] == ']' ) {
-	    break;
-	  }
-	}
+    token_stream_t ts;
+    tokenize_input( input, ts );
+    return std::vector<std::string>( ts.tokens.begin(), ts.tokens.end() );
+  }
 
-	if ( loc != input.size() ) {
-	  std::string tmp = input.substr( i, loc-i );
-	  ret.push_back( tmp );
-	  i = loc-1;
-	} else {
-	  std::string tmp = input.substr( i );
-	  ret.push_back( tmp );
-	  i = input.size();
+  // ========================== Scanner =============================================================
+
+  // Character classes of the scanner
+  enum scan_class : uint8_t { C_SPACE, C_OPEN, C_CLOSE, C_OPEN_SQ, C_CLOSE_SQ, C_DIGIT,
+			      C_ALPHA, C_T, C_F, C_BANG, C_MINUS, C_DOT, C_HASH, C_BSLASH,
+			      C_OTHER, NUM_CLASSES };
+
+  // States of the scanner, S_DONE marks the end of a token
+  enum scan_state : uint8_t { S_START, S_IDEN, S_MINUS, S_INT, S_INT_DOT, S_DEC, S_HASH,
+			      S_BOOL, S_CHAR_START, S_CHAR, S_OTHER, NUM_STATES, S_DONE = NUM_STATES };
+
+  // Character to class table
+  struct scan_classes_t {
+    constexpr scan_classes_t() : cls() {
+      for ( int c = 0; c < 256; ++c ) { cls[c] = C_OTHER; }
+      cls[(unsigned char)' '] = cls[(unsigned char)'\t'] = cls[(unsigned char)'\n'] = C_SPACE;
+      cls[(unsigned char)'\r'] = cls[(unsigned char)'\v'] = cls[(unsigned char)'\f'] = C_SPACE;
+      cls[(unsigned char)'('] = C_OPEN; cls[(unsigned char)')'] = C_CLOSE;
+      cls[(unsigned char)'['] = C_OPEN_SQ; cls[(unsigned char)']'] = C_CLOSE_SQ;
+      for ( int c = '0'; c <= '9'; ++c ) { cls[c] = C_DIGIT; }
+      for ( int c = 'a'; c <= 'z'; ++c ) { cls[c] = C_ALPHA; }
+      for ( int c = 'A'; c <= 'Z'; ++c ) { cls[c] = C_ALPHA; }
+      cls[(unsigned char)'_'] = C_ALPHA;
+      cls[(unsigned char)'t'] = C_T; cls[(unsigned char)'f'] = C_F;
+      cls[(unsigned char)'!'] = C_BANG; cls[(unsigned char)'-'] = C_MINUS;
+      cls[(unsigned char)'.'] = C_DOT; cls[(unsigned char)'#'] = C_HASH;
+      cls[(unsigned char)'\\'] = C_BSLASH;
+    }
+    uint8_t cls[256];
+  };
+
+  // State transition table, whitespace and parens always end a token
+  struct scan_table_t {
+    constexpr scan_table_t() : next(), accept() {
+      for ( int st = 0; st < NUM_STATES; ++st ) {
+	for ( int c = 0; c < NUM_CLASSES; ++c ) { next[st][c] = S_OTHER; }
+	next[st][C_SPACE] = next[st][C_OPEN] = next[st][C_CLOSE] = S_DONE;
+	next[st][C_OPEN_SQ] = next[st][C_CLOSE_SQ] = S_DONE;
+	accept[st] = tok_kind::OTHER;
+      }
+      // [a-zA-Z_][a-zA-Z_0-9!]*
+      next[S_START][C_ALPHA] = next[S_START][C_T] = next[S_START][C_F] = S_IDEN;
+      next[S_IDEN][C_ALPHA] = next[S_IDEN][C_T] = next[S_IDEN][C_F] = S_IDEN;
+      next[S_IDEN][C_DIGIT] = next[S_IDEN][C_BANG] = S_IDEN;
+      accept[S_IDEN] = tok_kind::IDENTIFIER;
+      // -?\d+ and -?\d+\.\d+
+      next[S_START][C_MINUS] = S_MINUS;
+      next[S_START][C_DIGIT] = next[S_MINUS][C_DIGIT] = S_INT;
+      next[S_INT][C_DIGIT] = S_INT;
+      next[S_INT][C_DOT] = S_INT_DOT;
+      next[S_INT_DOT][C_DIGIT] = next[S_DEC][C_DIGIT] = S_DEC;
+      accept[S_INT] = tok_kind::INTEGER;
+      accept[S_DEC] = tok_kind::DECIMAL;
+      // #t #f
+      next[S_START][C_HASH] = S_HASH;
+      next[S_HASH][C_T] = next[S_HASH][C_F] = S_BOOL;
+      accept[S_BOOL] = tok_kind::BOOLEAN;
+      // #\ followed by any single character
+      next[S_HASH][C_BSLASH] = S_CHAR_START;
+      for ( int c = C_DIGIT; c < NUM_CLASSES; ++c ) { next[S_CHAR_START][c] = S_CHAR; }
+      accept[S_CHAR] = tok_kind::CHARACTER;
+    }
+    uint8_t next[NUM_STATES][NUM_CLASSES];
+    tok_kind accept[NUM_STATES];
+  };
+
+  static constexpr scan_classes_t scan_classes;
+  static constexpr scan_table_t scan_table;
+
+  // === Run scanner DFA on a single token
+  tok_kind classify_token( std::string_view tk ) {
+    uint8_t state = S_START;
+    for ( char c : tk ) {
+      state = scan_table.next[state][scan_classes.cls[(unsigned char)c]];
+      if ( state == S_DONE ) { return tok_kind::OTHER; }
+    }
+    return scan_table.accept[state];
+  }
+
+  // === Split input string into token views in a single pass, then index parens
+  bool tokenize_input( std::string_view input, token_stream_t & ts ) {
+    ts.tokens.clear();
+    ts.kinds.clear();
+    size_t i = 0;
+    while ( i < input.size() ) {
+      uint8_t cls = scan_classes.cls[(unsigned char)input[i]];
+      if ( cls == C_SPACE ) { // WHITESPACE
+	++i;
+      } else if ( cls == C_OPEN || cls == C_CLOSE || cls == C_OPEN_SQ || cls == C_CLOSE_SQ ) { // PARENS
+	ts.tokens.push_back( input.substr( i, 1 ) );
+	ts.kinds.push_back( cls == C_OPEN ? tok_kind::OPEN : cls == C_CLOSE ? tok_kind::CLOSE :
+			    cls == C_OPEN_SQ ? tok_kind::OPEN_SQ : tok_kind::CLOSE_SQ );
+	++i;
+      } else { // run DFA until the token ends
+	size_t start = i;
+	uint8_t state = S_START;
+	for ( ; i < input.size(); ++i ) {
+	  uint8_t next = scan_table.next[state][scan_classes.cls[(unsigned char)input[i]]];
+	  if ( next == S_DONE ) { break; }
+	  state = next;
 	}
+	ts.tokens.push_back( input.substr( start, i-start ) );
+	ts.kinds.push_back( scan_table.accept[state] );
       }
     }
 
-    return ret;
+    std::string err = index_parens( ts );
+    if ( err.size() > 0 ) { // Error occurred
+      std::cerr << "Error while parsing input\n";
+      std::cerr << "Error: " << err;
+      std::cerr << "Input: " << input << std::endl;
+      ts.tokens.clear();
+      ts.kinds.clear();
+      ts.parens.clear();
+      return false;
+    }
+    return true;
+  }
+
+  // === Index matching parens with a stack of open parens
+  std::string index_parens( token_stream_t & ts ) {
+    const auto & kinds = ts.kinds;
+    ts.parens.assign( kinds.size(), std::string::npos );
+    std::vector<size_t> open;
+    for ( size_t i = 0; i < kinds.size(); ++i ) {
+      if ( kinds[i] == tok_kind::OPEN || kinds[i] == tok_kind::OPEN_SQ ) {
+	open.push_back( i );
+      } else if ( kinds[i] == tok_kind::CLOSE || kinds[i] == tok_kind::CLOSE_SQ ) {
+	if ( open.empty() ) { return "Missing opening paren"; }
+	size_t start = open.back();
+	open.pop_back();
+	if ( (kinds[start] == tok_kind::OPEN && kinds[i] != tok_kind::CLOSE) ||
+	     (kinds[start] == tok_kind::OPEN_SQ && kinds[i] != tok_kind::CLOSE_SQ) ) {
+	  return "Mismatching parens";
+	}
+	ts.parens[start] = i;
+	ts.parens[i] = start;
+      }
+    }
+    if ( !open.empty() ) { return "Missing closing paren"; }
+    return "";
   }
 
 
   // ================================== Primary Parsing Functions =====================================
 
   // === Match specific rule to list of tokens
-  std::unique_ptr<token_t> match_rule( const std::unique_ptr<language_t> & lang,
-				       std::string pn, str_vec rule,
-				       str_vec input, upoint pt, bool& match) {
+  token_ptr match_rule( const std::unique_ptr<language_t> & lang,
+				       const parser_t * par, size_t r,
+				       const token_stream_t & ts,
+				       memo_t & memo, upoint pt, bool& match) {
+    const str_vec & rule = par->rules[r];
+    const auto & res = par->regexes[r];
+    const auto & classes = par->classes[r];
+    const auto & input = ts.tokens;
+    const auto & parens = ts.parens;
   
-    std::unique_ptr<token_t> tptr( new token_t( pn ) );
+    token_ptr tptr( new token_t( par->kind ) );
     size_t in_itr = pt.first;
     size_t ru_itr = 0;
     bool try_again = false;
+    // Memoized aspects, given back if rule fails
+    std::vector<std::pair<memo_key, size_t> > taken;
+    auto fail = [&]() -> token_ptr {
+		  for ( auto & t : taken ) {
+		    memo[t.first].tk = std::move( tptr->aspects[t.second].tk );
+		  }
+		  return nullptr;
+		};
   
     for ( ; in_itr <= pt.second && ru_itr < rule.size(); ) {
       // Match parens
@@ -475,33 +970,31 @@ namespace psil_parser {
 	   rule[ru_itr] == "[" || rule[ru_itr]  == "]" ) {
 	if ( rule[ru_itr] == input[in_itr] ) {
 	  // Add result to token
-	  std::unique_ptr<token_elem_t> tke( new token_elem_t( input[in_itr] ) );
-	  tptr->aspects.push_back( std::move(tke) );
+	  tptr->aspects.emplace_back( input[in_itr] );
 	
 	  ++ru_itr; ++in_itr;
 	  continue;
 	} else {
-	  return nullptr;
+	  return fail();
 	}
       }
       // Check for expansion
       else if ( is_rule( rule[ru_itr] ) ) {
-	parser_t * next_p( lang->get_parser( rule[ru_itr] ) );
+	const parser_t * next_p = par->subparsers[r][ru_itr];
 	if ( next_p != nullptr ) {
-	  bool new_match = false;
+	  bool new_match = false, memoized = false;
 	  upoint new_pt;
-	  if ( input[in_itr] == "(" ) {
-	    auto p_loc = match_parens( in_itr, input );
-	    if ( p_loc.second.size() == 0 ) {
-	      new_pt = std::make_pair( in_itr, p_loc.first );
+	  if ( ts.kinds[in_itr] == tok_kind::OPEN ) {
+	    if ( parens[in_itr] <= pt.second ) {
+	      new_pt = std::make_pair( in_itr, parens[in_itr] );
 	    } else {
-	      return nullptr;
+	      return fail();
 	    }
 	  } else {
 	    new_pt = std::make_pair( in_itr, in_itr );
 	  }
 	
-	  auto new_ret = apply_parser( lang, next_p, input, new_pt, new_match );
+	  auto new_ret = apply_parser( lang, next_p, ts, memo, new_pt, new_match, &memoized );
 
 	  if ( rule[ru_itr].back() == '*' ) {
 	    try_again = true;
@@ -509,8 +1002,12 @@ namespace psil_parser {
 	  
 	  if ( new_match ) {
 	    // Add result to current token
-	    std::unique_ptr<token_elem_t> tke( new token_elem_t( std::move(new_ret) ) );
-	    tptr->aspects.push_back( std::move(tke) );
+
+	    if ( memoized ) {
+	      taken.push_back( std::make_pair( std::make_tuple( next_p, new_pt.first, new_pt.second ),
+					       tptr->aspects.size() ) );
+	    }
+	    tptr->aspects.emplace_back( std::move(new_ret) );
 
 	    if ( rule[ru_itr].back() == '+' ) {
 	      try_again = true;
@@ -528,7 +1025,7 @@ namespace psil_parser {
 	      ++ru_itr;
 	      continue;
 	    }
-	    return nullptr;
+	    return fail();
 	  }
 	} else {
 	  throw std::string("Error: Rule not found" + rule[ru_itr]);
@@ -536,24 +1033,25 @@ namespace psil_parser {
 	}
       }
       // Check for regex
-      else if ( is_regex( rule[ru_itr] ) ) {
-	if ( match_regex( rule[ru_itr], input[in_itr] ) ) {
-	  std::unique_ptr<token_elem_t> tke( new token_elem_t( input[in_itr] ) );
-	  tptr->aspects.push_back( std::move(tke) );
+      else if ( res[ru_itr] ) {
+	// Use class given by scanner if regex is bound to one
+	bool ok = ( classes[ru_itr] != tok_kind::NONE ) ? ts.kinds[in_itr] == classes[ru_itr]
+	  : match_regex( *res[ru_itr], input[in_itr] );
+	if ( ok ) {
+	  tptr->add_leaf( input[in_itr] );
 	  ++ru_itr; ++in_itr;
 	} else {
-	  return nullptr;
+	  return fail();
 	}
       }
       // Check for exactness
       else if ( rule[ru_itr] == input[in_itr] ) {
 	// Add result to current token
-	std::unique_ptr<token_elem_t> tke( new token_elem_t( input[in_itr] ) );
-	tptr->aspects.push_back( std::move(tke) );
+	tptr->aspects.emplace_back( input[in_itr] );
 	++ru_itr; ++in_itr;
 	continue;
       } else {
-	return nullptr;
+	return fail();
       }
     
     }
@@ -562,22 +1060,72 @@ namespace psil_parser {
     return tptr;
   }
 
-  // === Try all rules of a parser
-  std::unique_ptr<token_t>
+  // === Look up rules that can match a token in a dispatch table
+  static uint64_t predict_rules( const std::vector<uint64_t> & table, uint64_t any,
+				 const token_stream_t & ts, size_t i ) {
+    uint64_t ret = any | table[ static_cast<int>( ts.kinds[i] ) ];
+    if ( ts.terms[i] >= 0 ) { ret |= table[ ts.terms[i] ]; }
+    return ret;
+  }
+
+  // === Try the rules of a parser the next token predicts
+  token_ptr
   apply_parser( const std::unique_ptr<language_t> & lang,
-		parser_t * par, str_vec input_tks,
-		upoint pt, bool& match ) {
+		const parser_t * par, const token_stream_t & ts,
+		memo_t & memo, upoint pt, bool& match, bool * memoized ) {
+    size_t r_begin = 0, r_end = par->rules.size();
+    if ( par->literal_lookup ) { // Only the rule of the same word can match
+      int r = ( pt.first == pt.second ) ? par->literal_lookup( ts.tokens[pt.first] ) : -1;
+      r_begin = ( r < 0 ) ? r_end : r;
+      r_end = ( r < 0 ) ? r_end : r+1;
+    }
+    // Rules that can start with the next token, and the one after an open paren
+    uint64_t cand = ~uint64_t(0);
+    if ( !par->first.empty() ) {
+      cand = predict_rules( par->first, par->first_any, ts, pt.first );
+      if ( ts.kinds[pt.first] == tok_kind::OPEN || ts.kinds[pt.first] == tok_kind::OPEN_SQ ) {
+	cand &= predict_rules( par->second, par->second_any, ts, pt.first+1 );
+      }
+    }
+    auto predicted = [&]( size_t r ) { return r >= 64 || ( cand & ( uint64_t(1) << r ) ); };
+    size_t num_cand = 0;
+    for ( size_t r = r_begin; r < r_end && num_cand < 2; ++r ) {
+      if ( predicted( r ) ) { ++num_cand; }
+    }
+    // Spans only one rule is predicted for are not memoized, parsing them
+    // again is cheaper than the memo and it is rarely asked for
+    bool memoize = num_cand > 1;
+    if ( memoized != nullptr ) { *memoized = memoize; }
+    if ( num_cand == 0 ) { return nullptr; }
+    memo_key key = std::make_tuple( par, pt.first, pt.second );
+    if ( memoize ) {
+      auto hit = memo.find( key );
+      if ( hit != memo.end() ) {
+	if ( !hit->second.match ) { return nullptr; }
+	if ( hit->second.tk ) { // Hand out memoized token
+	  match = true;
+	  return std::move( hit->second.tk );
+	}
+	// Token is still held by another caller, parse span again
+      }
+    }
     bool new_match = false;
-    for ( str_vec rule : par->rules ) {
-      auto ret = match_rule( lang, par->name, rule, input_tks, pt, new_match );
-      if ( new_match ) { match = true; return ret; }
+    for ( size_t r = r_begin; r < r_end; ++r ) {
+      if ( !predicted( r ) ) { continue; }
+      auto ret = match_rule( lang, par, r, ts, memo, pt, new_match );
+      if ( new_match ) {
+	if ( memoize ) { memo[key].match = true; }
+	match = true;
+	return ret;
+      }
     }
+    if ( memoize ) { memo[key].match = false; }
     return nullptr;
   }
 
   // === Parsing driver function
-  std::unique_ptr<token_t>
-  parse( const std::unique_ptr<language_t> & lang, std::string input ) {
+  token_ptr
+  parse( const std::unique_ptr<language_t> & lang, const std::string & input ) {
     // Check for issues
     if ( input.size() == 0 ) {
       std::cerr << "Empty input" << std::endl;
@@ -589,13 +1137,17 @@ namespace psil_parser {
     }
 
     bool match = false;
+    memo_t memo;
     // === Split input into tokens ===
-    str_vec input_tokens = tokenize_input( input );
-    upoint pt = std::make_pair( 0, input_tokens.size()-1 );
+    token_stream_t ts;
+    if ( !tokenize_input( input, ts ) || ts.tokens.empty() ) { return nullptr; }
+    if ( !lang->compiled ) { lang->compile_tables(); }
+    lang->index_terminals( ts );
+    upoint pt = std::make_pair( 0, ts.tokens.size()-1 );
 
     try {
       for ( auto parser : lang->get_top_parsers() ) { // reduce to top level parsers
-	auto ret = apply_parser( lang, parser, input_tokens, pt, match );
+	auto ret = apply_parser( lang, parser, ts, memo, pt, match );
 	if ( match ) { return ret; }
       }
     } catch ( std::string exp ) {
@@ -608,10 +1160,90 @@ namespace psil_parser {
 
   // ========================== Premade functionality =======================================================
 
+  // Keywords and operators of PSIL, the grammar is built from these lists
+  static constexpr std::string_view psil_keywords[] = {
+    "define", "update", "lambda", "if", "cond", "begin", "length",
+    "and", "or", "not", "equal?", "floor", "ceil", "trunc", "round",
+    "zero?", "first", "second", "nth", "first!", "second!", "nth!",
+    "null?", "ch_lt", "ch_lte", "ch_gt", "ch_gte", "ch_eq", "decimal?",
+    "lt", "lte", "gt", "gte", "eq", "append", "insert", "pop", "integer?",
+    "boolean?", "number?", "character?", "symbol?", "proc?", "list?",
+    "abs", "mod", "print", "println", "newline", "read",
+    "quote", "to_quote", "unquote" };
+  static constexpr std::string_view psil_operators[] = { "+", "-", "*", "/" };
+
+  // FNV-1a hash of a word with a seed
+  static constexpr uint32_t word_hash( std::string_view w, uint32_t seed ) {
+    uint32_t h = 2166136261u ^ seed;
+    for ( char c : w ) { h = ( h ^ (unsigned char)c ) * 16777619u; }
+    return h;
+  }
+
+  /**
+     Perfect Hash
+     Maps each word of a list to its index without collisions,
+     the seed is searched for at compile time
+  */
+  template <size_t N>
+  struct perfect_hash_t {
+    static constexpr size_t SIZE = 512;
+
+    constexpr perfect_hash_t( const std::string_view (&w)[N] ) : words(w), seed(0), slots() {
+      while ( !try_seed() ) { ++seed; }
+    }
+
+    // Index of word, -1 if not in list
+    constexpr int find( std::string_view w ) const {
+      int i = slots[ word_hash( w, seed ) % SIZE ];
+      return ( i >= 0 && words[i] == w ) ? i : -1;
+    }
+
+    const std::string_view (&words)[N];
+    uint32_t seed;
+    int slots[SIZE];
+
+  private:
+    constexpr bool try_seed() {
+      for ( size_t i = 0; i < SIZE; ++i ) { slots[i] = -1; }
+      for ( size_t i = 0; i < N; ++i ) {
+	int & s = slots[ word_hash( words[i], seed ) % SIZE ];
+	if ( s >= 0 ) { return false; }
+	s = i;
+      }
+      return true;
+    }
+  };
+
+  static constexpr perfect_hash_t keyword_hash( psil_keywords );
+  static constexpr perfect_hash_t operator_hash( psil_operators );
+
+  static int lookup_keyword( std::string_view w ) { return keyword_hash.find( w ); }
+  static int lookup_operator( std::string_view w ) { return operator_hash.find( w ); }
+
+  // Join word list into alternatives of a rule
+  template <size_t N>
+  static std::string make_rule( const std::string_view (&words)[N] ) {
+    std::string rule;
+    for ( size_t i = 0; i < N; ++i ) {
+      if ( i > 0 ) { rule += " | "; }
+      rule += words[i];
+    }
+    return rule;
+  }
+
   // === Make PSIL language
   std::unique_ptr<language_t> make_psil_lang() {
     try {
       std::unique_ptr<language_t> lang( new language_t( "PSIL" ) );
+
+      // Token classes of the scanner, so these regexes never run while parsing
+      lang->add_token_class( "{^[a-zA-Z_](?!.)}", tok_kind::IDENTIFIER );
+      lang->add_token_class( "{^[a-zA-Z_][a-zA-Z_0-9\\!]+(?!.)}", tok_kind::IDENTIFIER );
+      lang->add_token_class( "{^(#\\\\).(?!.)}", tok_kind::CHARACTER );
+      lang->add_token_class( "{\\d+(?!\\w)}", tok_kind::INTEGER );
+      lang->add_token_class( "{-\\d+(?!\\w)}", tok_kind::INTEGER );
+      lang->add_token_class( "{\\d+(?!\\w)\\.\\d+(?!\\w)}", tok_kind::DECIMAL );
+      lang->add_token_class( "{-\\d+(?!\\w)\\.\\d+(?!\\w)}", tok_kind::DECIMAL );
     
       lang->add( new parser_t( "<program>", "<form>" ) );
   
@@ -644,16 +1276,10 @@ namespace psil_parser {
       lang->add( gi, new parser_t( "<identifier>",
 				   "<keyword> | <operator> | {^[a-zA-Z_](?!.)}"
 				   "| {^[a-zA-Z_][a-zA-Z_0-9\\!]+(?!.)}" ) );
-      lang->add( gi, new parser_t( "<operator>", "+ | - | * | /" ) );
-      lang->add( gi, new parser_t( "<keyword>",
-				   "define | update | lambda | if | cond | begin | length"
-				   "| and | or | not | equal? | floor | ceil | trunc | round"
-				   "| zero? | first | second | nth | first! | second! | nth!"
-				   "| null? | ch_lt | ch_lte | ch_gt | ch_gte | ch_eq | decimal?"
-				   "| lt | lte | gt | gte | eq | append | insert | pop | integer?"
-				   "| boolean? | number? | character? | symbol? | proc? | list?"
-				   "| abs | mod | print | println | newline | read "
-				   "| quote | to_quote | unquote" ) );
+      lang->add( gi, new parser_t( "<operator>", make_rule( psil_operators ) ) )
+	->literal_lookup = lookup_operator;
+      lang->add( gi, new parser_t( "<keyword>", make_rule( psil_keywords ) ) )
+	->literal_lookup = lookup_keyword;
     
       group_t * gda = lang->add( new group_t( "DATA" ) );
       lang->add( gda, new parser_t( "<list_def>", "(quote <datum>)" ) );
@@ -672,6 +1298,7 @@ namespace psil_parser {
       lang->add( gn, new parser_t( "<decimal>",
 				   "0.0 | {\\d+(?!\\w)\\.\\d+(?!\\w)}"
 				   "| {-\\d+(?!\\w)\\.\\d+(?!\\w)}" ) );
+      lang->compile_tables();
       return lang;
     } catch ( std::string exp ) {
       std::cerr << "Error: While creating language" << std::endl;
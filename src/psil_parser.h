@@ -10,11 +10,18 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <cctype>
+#include <cstdint>
 #include <memory>
 #include <regex>
 #include <vector>
 #include <map>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include "psil_small_vec.h"
 
 namespace psil_parser {
 
@@ -30,41 +37,286 @@ namespace psil_parser {
   // ====== Typedefs =============
   using str_vec = std::vector<std::string>;
   using upoint = std::pair<size_t, size_t>;
+
+  /**
+     Token Kind
+     Lexical class of an input token, found by the scanner
+     NONE is used for rule elements that are not bound to a class
+  */
+  enum class tok_kind : uint8_t { NONE, OPEN, CLOSE, OPEN_SQ, CLOSE_SQ,
+				  INTEGER, DECIMAL, IDENTIFIER, CHARACTER, BOOLEAN, OTHER };
+  constexpr int NUM_TOK_KINDS = static_cast<int>( tok_kind::OTHER ) + 1;
+
+  /**
+     Node Kind
+     Interned type name of a token, the kinds of PSIL are fixed,
+     names of other parsers are given kinds after NUM_FIXED when interned
+     FRAME is never parsed, it holds the arguments of a lambda while it runs
+  */
+  enum class node_kind : uint16_t { PROGRAM, FORM, DEFINITION, VARIABLE, EXPRESSION, CONSTANT,
+				    LAMBDA, FORMALS, BODY, CONDITIONAL, APPLICATION, IDENTIFIER,
+				    OPERATOR, KEYWORD, LIST_DEF, DATUM, BOOLEAN, CHARACTER, SYMBOL,
+				    LIST, NUMBER, INTEGER, DECIMAL, FRAME, NUM_FIXED };
+
+  /**
+     Find the kind of a type name, giving it a new kind if it has none
+     @param name - type name such as <expression>
+     @return kind of name
+  */
+  node_kind intern_kind( std::string_view name );
+
+  /**
+     Find the type name of a kind
+     @param k - interned kind
+     @return type name of k
+  */
+  const std::string & kind_name( node_kind k );
+
+  /**
+     Head Kind
+     What opened a parenthesized node once lowering has dropped its punctuation,
+     PAREN for plain parens and the keyword otherwise
+     NONE for nodes that are not lowered or have no parens
+  */
+  enum class head_kind : uint8_t { NONE, PAREN, BEGIN, DEFINE, UPDATE, LAMBDA, COND, IF, QUOTE };
+
+  /**
+     Find the keyword of a head
+     @param h - head of lowered node
+     @return keyword, empty for NONE and PAREN
+  */
+  const std::string & head_name( head_kind h );
+
+  /**
+     Variable Type
+     Type of the value a <constant> or <datum> token holds,
+     tagged on the token when it is made, UNKNOWN on tokens that hold no value
+  */
+  enum class VarType : uint8_t { BOOL, CHAR, NUM, LIST, PROC, SYMBOL, UNKNOWN, ERROR };
   
   // ===== Token =======================================
 
+  /**
+     Intern a string, equal strings share one copy for the life of the program
+     Used for names and other text of the syntax, text of numbers is kept by their tokens
+     @param s - string to intern
+     @return pointer to the interned copy of s
+  */
+  const std::string * intern_str( std::string_view s );
+
+  // Interned empty string, held by token elements
+  inline const std::string * empty_str() {
+    static const std::string * e = intern_str( "" );
+    return e;
+  }
+
+  /**
+     Token Pointer
+     Owning pointer to a token that works like unique_ptr, except that
+       share() lets several pointers hold the same token, which is freed
+       when the last of them lets go
+     A shared token must not be changed, own() first gives the pointer
+       a copy of its own whose children are shared in turn
+  */
+  class token_ptr {
+  public:
+    token_ptr() : p(nullptr) {}
+    token_ptr( std::nullptr_t ) : p(nullptr) {}
+    explicit token_ptr( token_t * t ) : p(t) {}
+    token_ptr( token_ptr && o ) noexcept : p(o.p) { o.p = nullptr; }
+    token_ptr & operator=( token_ptr && o ) noexcept {
+      if ( this != &o ) { reset( o.release() ); }
+      return *this;
+    }
+    token_ptr & operator=( std::nullptr_t ) { reset(); return *this; }
+    token_ptr( const token_ptr & ) = delete;
+    token_ptr & operator=( const token_ptr & ) = delete;
+    ~token_ptr() { drop( p ); }
+
+    token_t * get() const { return p; }
+    token_t * operator->() const { return p; }
+    token_t & operator*() const { return *p; }
+    explicit operator bool() const { return p != nullptr; }
+
+    // Point to t, letting go of the old token afterwards
+    void reset( token_t * t = nullptr ) {
+      token_t * old = p;
+      p = t;
+      drop( old );
+    }
+    // Give up token without letting go of it
+    token_t * release() {
+      token_t * t = p;
+      p = nullptr;
+      return t;
+    }
+
+    token_ptr share() const;
+    bool shared() const;
+    void own();
+
+  private:
+    static void drop( token_t * t );
+
+    token_t * p;
+  };
+
+  inline bool operator==( const token_ptr & a, std::nullptr_t ) { return !a; }
+  inline bool operator!=( const token_ptr & a, std::nullptr_t ) { return (bool)a; }
+  inline bool operator==( std::nullptr_t, const token_ptr & a ) { return !a; }
+  inline bool operator!=( std::nullptr_t, const token_ptr & a ) { return (bool)a; }
+
   /**
      Token Element
      Holds either a string or another token
-     Is used in the aspects vector in the token struct
+     Is stored inline in the aspects vector in the token struct
      elem_type signifies which type is contained within element
+     s: interned string, the empty string for tokens,
+       or text of a number when owned is set, kept in an arena and destroyed with the element
   */
   struct token_elem_t {
-    token_elem_t( std::string s ) : elem_type(STRING), str(s) {}
-    token_elem_t( std::unique_ptr<token_t> p ) : elem_type(TOKEN), tk(std::move(p)) {}
-    token_elem_t( token_t * p ) : elem_type(TOKEN), tk(p) {}
-
-    enum TE_Type { STRING, TOKEN };
+    token_elem_t( std::string_view str ) : elem_type(STRING), owned(false), s( intern_str( str ) ), tk() {}
+    token_elem_t( const std::string * interned ) : elem_type(STRING), owned(false), s(interned), tk() {}
+    token_elem_t( arena_t & arena, std::string_view str ) :
+      elem_type(STRING), owned(true), s( arena.new_str( str ) ), tk() {}
+    token_elem_t( token_ptr p ) : elem_type(TOKEN), owned(false), s( empty_str() ), tk(std::move(p)) {}
+    token_elem_t( token_t * p ) : elem_type(TOKEN), owned(false), s( empty_str() ), tk(p) {}
+    token_elem_t( token_elem_t && o ) noexcept : elem_type(o.elem_type), owned(o.owned), s(o.s), tk(std::move(o.tk)) {
+      o.owned = false;
+      o.s = empty_str();
+    }
+    token_elem_t & operator=( token_elem_t && o ) noexcept {
+      if ( this == &o ) { return *this; }
+      if ( owned ) { arena_t::free_str( s ); }
+      elem_type = o.elem_type;
+      owned = o.owned;
+      s = o.s;
+      tk = std::move( o.tk );
+      o.owned = false;
+      o.s = empty_str();
+      return *this;
+    }
+    ~token_elem_t() { if ( owned ) { arena_t::free_str( s ); } }
+
+    const std::string & str() const { return *s; }
+
+    enum TE_Type : uint8_t { STRING, TOKEN };
     TE_Type elem_type;
-    std::string str;
-    std::unique_ptr<token_t> tk;
+    bool owned;
+    const std::string * s;
+    token_ptr tk;
   };
 
+  /**
+     Binary value of a number, i for <integer> and d for <decimal>
+  */
+  union number_t {
+    long long i;
+    long double d;
+  };
+
+  // Slots of <variable> tokens without a lexical address, see psil_eval::resolve_node
+  constexpr uint16_t NO_SLOT = 0xffff; // not resolved, looked up by name
+  constexpr uint16_t FREE_SLOT = 0xfffe; // bound by no lambda around it, only in symbol tables
+
   /**
      Token
      Represents the nodes in the abstract syntax tree
-     type_name: category derived from parser in parsing syntax tree
+     kind: category derived from parser in parsing syntax tree
+     head: what opened the node if it is lowered, see head_kind
+     vtype: type of the value held by <constant> and <datum> tokens,
+       PROC for <lambda> tokens that have been made into closures
+     hash: structural hash of <constant> and <datum> tokens, 0 until it is found
+     num: binary value of <integer> and <decimal> tokens, see read_number
+     depth, slot: lexical address of <variable> tokens, frames up and argument index
+     refs: number of token pointers holding the token
+     aspects: children, kept inline for the common case of a few children
+     Tokens are allocated from the current arena, freed to the arena they came from
+       and without recursion
   */
   struct token_t {
-    token_t( std::string t ) : type_name(t) {}
+    token_t( node_kind k, head_kind h = head_kind::NONE ) :
+      kind(k), head(h), vtype( VarType::UNKNOWN ), refs(1), hash(0), depth(0), slot( NO_SLOT ),
+      num() {}
+    token_t( std::string_view t ) :
+      kind( intern_kind( t ) ), head( head_kind::NONE ), vtype( VarType::UNKNOWN ), refs(1), hash(0),
+      depth(0), slot( NO_SLOT ), num() {}
+    ~token_t();
+
+    static void * operator new( size_t n ) { return arena_alloc( n ); }
+    static void operator delete( void * p, size_t n ) { arena_free( p, n ); }
     
     void print();
     std::string to_code();
+    // Add text of leaf, text of numbers is kept in the arena of the token, other text is interned
+    void add_leaf( std::string_view t );
+    // Add copy of string element, interned strings are shared
+    void add_str( const token_elem_t & elem );
+    const std::string & type_name() const { return kind_name( kind ); }
     
-    std::string type_name;
-    std::vector<std::unique_ptr<token_elem_t> > aspects;
+    node_kind kind;
+    head_kind head;
+    VarType vtype;
+    uint32_t refs;
+    uint32_t hash;
+    uint16_t depth;
+    uint16_t slot;
+    number_t num;
+    small_vec<token_elem_t, 3> aspects;
   };
 
+  // Another pointer to the same token
+  inline token_ptr token_ptr::share() const {
+    if ( p != nullptr ) { ++p->refs; }
+    return token_ptr( p );
+  }
+
+  // Whether other pointers hold the token too
+  inline bool token_ptr::shared() const {
+    return p != nullptr && p->refs > 1;
+  }
+
+  // Let go of token, freeing it if no other pointer holds it
+  inline void token_ptr::drop( token_t * t ) {
+    if ( t != nullptr && --t->refs == 0 ) { delete t; }
+  }
+
+  /**
+     Set binary value of <integer> or <decimal> token from the text it holds,
+     numbers whose text does not fit are given vtype ERROR, others NUM
+     @param tk - number token
+  */
+  void read_number( token_t * tk );
+
+  /**
+     Give <integer> or <decimal> token the text of its binary value if it has none,
+     numbers made by arithmetic hold no text until they are printed
+     @param tk - number token
+     @return text of number
+  */
+  const std::string & write_number( token_t * tk );
+
+  /**
+     Whether <integer> or <decimal> tokens hold the same value, compared by binary value
+     without writing their text, numbers with vtype ERROR compare as written
+     @param a, b - number tokens
+     @return true if both are the same kind of number with the same value
+  */
+  bool same_number( const token_t * a, const token_t * b );
+
+  /**
+     Hash of the value of <integer> or <decimal> token, equal for numbers same_number matches
+     @param tk - number token
+     @return hash of number
+  */
+  uint64_t hash_number( const token_t * tk );
+
+  // Make new token owned by a token pointer
+  template <typename... Args>
+  token_ptr make_token( Args&&... args ) {
+    return token_ptr( new token_t( std::forward<Args>( args )... ) );
+  }
+
 
   // ===== Parser =======================================
   
@@ -72,17 +324,81 @@ namespace psil_parser {
      Parser
      Holds list of rules for each named
        category of the language tree
+     kind: interned name, given to the tokens the parser makes
+     regexes: compiled {regex} elements of each rule,
+       parallel to rules, nullptr for elements that are not regexes
+     classes: token kind each {regex} element is bound to by the language,
+       parallel to rules, NONE if the regex has to be run
+     subparsers: parser of each <rule> element, parallel to rules,
+       nullptr for other elements, resolved by the language's compile_tables
+     literal_lookup: optional, for parsers whose rules are all single words,
+       gives index of the rule matching a token or -1, so only that rule is tried
+     first: predictive dispatch table, bitmask of rules that can start with
+       each terminal, empty if the parser has too many rules for a bitmask
+     second: bitmask of rules that can have each terminal after an open paren
+     first_any, second_any: rules that can start with / follow with any token
   */
   struct parser_t {
-    parser_t( std::string n ) : name(n) {}
+    parser_t( std::string n ) : name(n), kind( intern_kind( n ) ), literal_lookup(nullptr),
+				first_any(0), second_any(0) {}
     parser_t( std::string n, std::string rs );
 
     void print( int depth ) const;
     
     std::string name;
+    node_kind kind;
     std::vector<str_vec> rules;
+    std::vector<std::vector<std::unique_ptr<std::regex> > > regexes;
+    std::vector<std::vector<tok_kind> > classes;
+    std::vector<std::vector<const parser_t *> > subparsers;
+    int (*literal_lookup)( std::string_view );
+    std::vector<uint64_t> first, second;
+    uint64_t first_any, second_any;
+  };
+
+  // ===== Token Stream =================================
+
+  /**
+     Token Stream
+     Tokenized user input, each token is a view into the input buffer,
+     so the buffer must outlive the stream
+     kinds: lexical class of each token
+     terms: terminal id of each token given by the language, -1 if not a word of the grammar
+     parens: location of the matching paren for each paren token,
+             npos for every other token
+  */
+  struct token_stream_t {
+    std::vector<std::string_view> tokens;
+    std::vector<tok_kind> kinds;
+    std::vector<size_t> parens;
+    std::vector<int> terms;
+  };
+
+  // ===== Parse Memo ===================================
+
+  /**
+     Memo Entry
+     Result of applying a parser to a span of input
+     match: whether the parser matched the span
+     tk: matched token, handed to the caller on a hit and given back
+         by the caller if the caller's rule fails, nullptr while handed out
+  */
+  struct memo_entry_t {
+    bool match;
+    token_ptr tk;
   };
 
+  // Memo table keyed by parser and span of input
+  using memo_key = std::tuple<const parser_t *, size_t, size_t>;
+  struct memo_hash_t {
+    size_t operator()( const memo_key & k ) const {
+      size_t h = std::hash<const parser_t *>()( std::get<0>(k) );
+      h = h * 31 + std::get<1>(k);
+      return h * 31 + std::get<2>(k);
+    }
+  };
+  using memo_t = std::unordered_map<memo_key, memo_entry_t, memo_hash_t>;
+
   // ===== Parser Group =================================
 
   /**
@@ -122,16 +438,27 @@ namespace psil_parser {
      Holds full structure of language
      items is used to mantain structure
      all_parsers is used for fast parser lookup
+     token_classes maps {regex} rule elements to the token kind
+       the scanner gives tokens the regex matches
+     terminals maps words of the grammar to terminal ids, ids below
+       NUM_TOK_KINDS are token kinds
+     compiled is whether the dispatch tables match the current parsers
   */
   struct language_t {
-    language_t( std::string n ) : name(n), items(), all_parsers() {}
+    language_t( std::string n ) : name(n), items(), all_parsers(), compiled(false) {}
 
     parser_t * add( parser_t * p );
     group_t  * add( group_t  * g );
     parser_t * add( group_t  * g,   parser_t * p );
     group_t  * add( group_t  * g_up, group_t * g_down );
 
-    parser_t * get_parser( std::string pn ) const;
+    void add_token_class( std::string regex, tok_kind k );
+    void bind_classes( parser_t * p ) const;
+
+    void compile_tables();
+    void index_terminals( token_stream_t & ts ) const;
+
+    parser_t * get_parser( std::string_view pn ) const;
 
     std::vector<parser_t*> get_top_parsers() const;
 
@@ -139,7 +466,10 @@ namespace psil_parser {
 
     std::string name;
     std::vector<std::unique_ptr<lang_elem_t> > items;
-    std::map<std::string, std::unique_ptr<parser_t> > all_parsers;
+    std::map<std::string, std::unique_ptr<parser_t>, std::less<> > all_parsers;
+    std::map<std::string, tok_kind> token_classes;
+    std::map<std::string, int, std::less<> > terminals;
+    bool compiled;
   };
 
   // ========================================================================================================
@@ -161,7 +491,7 @@ namespace psil_parser {
      @param input - string to be checked
      @return whether the input string is a rule
   */
-  bool is_rule( std::string input );
+  bool is_rule( const std::string & input );
 
   /**
      Checks if the input is a regex expression
@@ -169,7 +499,7 @@ namespace psil_parser {
      @param input - string to be checked
      @return whether the input string is a regex
   */
-  bool is_regex( std::string input );
+  bool is_regex( const std::string & input );
 
   /**
      Takes if the input matches the regex expression
@@ -179,6 +509,21 @@ namespace psil_parser {
   */
   bool match_regex( std::string expression, std::string input );
 
+  /**
+     Compiles a regex rule element, without its curly braces
+     @param expression - string that has been proven to be a regex
+     @return compiled regex
+  */
+  std::unique_ptr<std::regex> compile_regex( const std::string & expression );
+
+  /**
+     Takes if the input matches the compiled regex
+     @param re - compiled regex
+     @param input - token to be matched against the regex
+     @return whether the regex matches the entire input token
+  */
+  bool match_regex( const std::regex & re, std::string_view input );
+
   /**
      Verifies the entire input string has matching parens
      @param input - string to be checked
@@ -197,6 +542,13 @@ namespace psil_parser {
   std::pair<size_t, std::string> match_parens( size_t start, std::string input );
   std::pair<size_t, std::string> match_parens( size_t start, str_vec input );
 
+  /**
+     Index matching parens of a token stream in a single pass
+     @param ts - token stream, its parens are filled in
+     @return error message if parens do not match, "" if they do
+  */
+  std::string index_parens( token_stream_t & ts );
+
   // ========================== Parsing functions ==========================================================
 
   /**
@@ -213,34 +565,58 @@ namespace psil_parser {
   */
   std::vector<std::string> tokenize_input( std::string input );
 
+  /**
+     Classify a single token with the scanner's DFA
+     @param tk - token without whitespace or parens
+     @return lexical class of the token
+  */
+  tok_kind classify_token( std::string_view tk );
+
+  /**
+     Break user input string into a token stream and index its parens
+     Tokens are classified while they are scanned
+     @param input - string to be tokenized, must outlive ts
+     @param ts - token stream to fill
+     @return whether input was tokenized, false on mismatching parens
+  */
+  bool tokenize_input( std::string_view input, token_stream_t & ts );
+
   /**
      Convert user's tokenized input to tokens
      by using rules from the language
      @param lang - pointer to language being used to parse
-     @param pn - name of parser
-     @param rule - tokenized rule, vector of strings
-     @param input - tokenized user input, vector of strings
+     @param par - parser the rule belongs to
+     @param r - index of rule in parser
+     @param ts - tokenized user input
+     @param memo - results of parsers already applied to spans of input
      @param pt - pair of size_t values that represents starting and ending (inclusive) 
                  locations of where function is parsing in input
      @param match - pass by reference flag to return when a proper match has been found
      @return pointer to abstract syntax tree if success, otherwise nullptr
   */
-  std::unique_ptr<token_t> match_rule( const std::unique_ptr<language_t> & lang,
-				       std::string pn, str_vec rule,
-				       str_vec input, upoint pt, bool& match);
+  token_ptr match_rule( const std::unique_ptr<language_t> & lang,
+				       const parser_t * par, size_t r,
+				       const token_stream_t & ts,
+				       memo_t & memo, upoint pt, bool& match);
 
   /**
-     Calls all rules of a parser
+     Calls the rules of a parser the dispatch tables predict, unless the memo
+     already holds the result of the parser on the span
+     Only spans more than one rule is predicted for are memoized
      @param lang - pointer to language being used to parse
      @param par - parser to be applied
-     @param input_tks - tokenized user input, vector of strings
+     @param ts - tokenized user input
+     @param memo - results of parsers already applied to spans of input
      @param pt - pair of size_t values that represents starting and ending (inclusive) 
                  locations of where function is parsing in input
      @param match - pass by reference flag to return when a proper match has been found
+     @param memoized - optional, set to whether the result is kept in the memo
      @return pointer to abstract syntax tree if success, otherwise nullptr
   */
-  std::unique_ptr<token_t> apply_parser( const std::unique_ptr<language_t> & lang, parser_t * par,
-					 str_vec input_tks, upoint pt, bool& match );
+  token_ptr apply_parser( const std::unique_ptr<language_t> & lang, const parser_t * par,
+					 const token_stream_t & ts,
+					 memo_t & memo, upoint pt, bool& match,
+					 bool * memoized = nullptr );
 
   /**
      Primary parsing driver function
@@ -249,7 +625,7 @@ namespace psil_parser {
      @param input - string of user input
      @return pointer to abstract syntax tree if success, otherwise nullptr
   */
-  std::unique_ptr<token_t> parse( const std::unique_ptr<language_t> & lang, std::string input );
+  token_ptr parse( const std::unique_ptr<language_t> & lang, const std::string & input );
   
   // ========================== Premade functionality ======================================================
 
@@ -0,0 +1,128 @@
+/**
+    psil_small_vec.h
+    PSIL Small Vector
+    @author Sinclair Gurny
+    @version 1.0
+    July 2019
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include "psil_arena.h"
+
+namespace psil_parser {
+
+  /**
+     Small Vector
+     Vector that keeps up to N elements inline, only larger vectors
+     are moved to the current arena, used for the children of AST nodes
+     Iterators are pointers and are invalidated by any insertion or erasure
+  */
+  template <typename T, uint32_t N>
+  class small_vec {
+  public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    small_vec() : ptr( inline_data() ), len(0), cap(N) {}
+    ~small_vec() { clear(); release(); }
+
+    small_vec( small_vec && o ) : ptr( inline_data() ), len(0), cap(N) { take( std::move( o ) ); }
+    small_vec & operator=( small_vec && o ) {
+      if ( this != &o ) {
+	clear();
+	release();
+	ptr = inline_data(); cap = N;
+	take( std::move( o ) );
+      }
+      return *this;
+    }
+    small_vec( const small_vec & ) = delete;
+    small_vec & operator=( const small_vec & ) = delete;
+
+    // ====== Access =============
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    T & operator[]( size_t i ) { return ptr[i]; }
+    const T & operator[]( size_t i ) const { return ptr[i]; }
+    T & front() { return ptr[0]; }
+    const T & front() const { return ptr[0]; }
+    T & back() { return ptr[len-1]; }
+    const T & back() const { return ptr[len-1]; }
+    iterator begin() { return ptr; }
+    iterator end() { return ptr + len; }
+    const_iterator begin() const { return ptr; }
+    const_iterator end() const { return ptr + len; }
+
+    // ====== Modify =============
+    void reserve( size_t n ) {
+      if ( n <= cap ) { return; }
+      T * next = static_cast<T*>( arena_alloc( n * sizeof(T) ) );
+      for ( uint32_t i = 0; i < len; ++i ) {
+	new ( next + i ) T( std::move( ptr[i] ) );
+	ptr[i].~T();
+      }
+      release();
+      ptr = next;
+      cap = n;
+    }
+
+    template <typename... Args>
+    T & emplace_back( Args&&... args ) {
+      if ( len == cap ) { reserve( cap * 2 ); }
+      new ( ptr + len ) T( std::forward<Args>( args )... );
+      return ptr[len++];
+    }
+
+    void push_back( T && v ) { emplace_back( std::move( v ) ); }
+    void pop_back() { ptr[--len].~T(); }
+
+    iterator insert( iterator pos, T && v ) {
+      size_t idx = pos - ptr;
+      emplace_back( std::move( v ) );
+      for ( size_t i = len-1; i > idx; --i ) { std::swap( ptr[i], ptr[i-1] ); }
+      return ptr + idx;
+    }
+
+    iterator erase( iterator pos ) {
+      for ( iterator itr = pos; itr + 1 != end(); ++itr ) { *itr = std::move( *(itr+1) ); }
+      ptr[--len].~T();
+      return pos;
+    }
+
+    void clear() {
+      for ( uint32_t i = 0; i < len; ++i ) { ptr[i].~T(); }
+      len = 0;
+    }
+
+  private:
+    T * inline_data() { return reinterpret_cast<T*>( buf ); }
+
+    // Free arena storage, elements must already be destroyed
+    void release() {
+      if ( ptr != inline_data() ) { arena_free( ptr, cap * sizeof(T) ); }
+    }
+
+    // Take elements of o, stealing its arena storage if it has any
+    void take( small_vec && o ) {
+      if ( o.ptr != o.inline_data() ) {
+	ptr = o.ptr; len = o.len; cap = o.cap;
+	o.ptr = o.inline_data(); o.len = 0; o.cap = N;
+	return;
+      }
+      for ( uint32_t i = 0; i < o.len; ++i ) { emplace_back( std::move( o.ptr[i] ) ); }
+      o.clear();
+    }
+
+    T * ptr;
+    uint32_t len;
+    uint32_t cap;
+    alignas(T) unsigned char buf[ N * sizeof(T) ];
+  };
+
+}
@@ -0,0 +1,559 @@
+/**
+    psil_vm.cpp
+    PSIL Bytecode Virtual Machine Implementation
+    @author Sinclair Gurny
+    @version 1.0
+    July 2019
+*/
+
+#include "psil_vm.h"
+
+namespace psil_vm {
+
+  using VarType = psil_parser::VarType;
+  using ExistsType = psil_exec::stack_t::ExistsType;
+
+  // ========== Compiler ==============================================
+
+  size_t compiler_t::emit( op_t op, size_t a, size_t b ) {
+    chunk.code.push_back( instr_t{ op, static_cast<uint32_t>( a ), static_cast<uint32_t>( b ) } );
+    return chunk.code.size() - 1;
+  }
+
+  size_t compiler_t::add_const( const token_ptr & tk ) {
+    chunk.consts.push_back( tk.share() );
+    return chunk.consts.size() - 1;
+  }
+
+  size_t compiler_t::add_str( const std::string & s ) {
+    chunk.strs.push_back( s );
+    return chunk.strs.size() - 1;
+  }
+
+  size_t compiler_t::add_name( const std::string * n ) {
+    chunk.names.push_back( n );
+    return chunk.names.size() - 1;
+  }
+
+  // Global table is filled when stack is made, so globals are known while compiling
+  bool compiler_t::is_global( const std::string * n ) const {
+    return stack->global_table.find( n ) != stack->global_table.end();
+  }
+
+  // === Any node exec can run
+  void compiler_t::node( const token_ptr & tk ) {
+    switch ( tk->kind ) {
+    case NK::PROGRAM:
+      if ( !tk->aspects.empty() && tk->aspects.front().elem_type == TE_Type::TOKEN ) {
+	node( tk->aspects.front().tk );
+      } else {
+	emit( op_t::VOID );
+      }
+      return;
+    case NK::FORM:
+      begin( tk, tk->head == HK::BEGIN );
+      return;
+    case NK::DEFINITION:
+      definition( tk );
+      return;
+    case NK::EXPRESSION:
+      expression( tk );
+      return;
+    default:
+      emit( op_t::VOID );
+      return;
+    }
+  }
+
+  // === Children of form or begin expression, in a new scope when scoped
+  void compiler_t::begin( const token_ptr & tk, bool scoped ) {
+    if ( scoped ) { emit( op_t::PUSH_SCOPE ); }
+    size_t count = 0;
+    for ( auto & elem : tk->aspects ) {
+      if ( elem.elem_type == TE_Type::TOKEN ) {
+	node( elem.tk );
+	++count;
+      }
+    }
+    emit( op_t::COLLECT, count );
+    if ( scoped ) { emit( op_t::POP_SCOPE ); }
+  }
+
+  void compiler_t::expression( const token_ptr & tk ) {
+    if ( tk->head == HK::BEGIN ) {
+      begin( tk, true );
+      return;
+    }
+    if ( tk->aspects.size() != 1 || tk->aspects.front().elem_type != TE_Type::TOKEN ) {
+      emit( op_t::FAIL, add_str( "Unknown expression type" ) );
+      return;
+    }
+    auto & expr = tk->aspects.front().tk;
+    switch ( expr->kind ) {
+    case NK::CONSTANT:
+      emit( op_t::CONST, add_const( tk ) );
+      return;
+    case NK::VARIABLE: {
+      //            <identifier>
+      auto & var = expr->aspects.front().tk->aspects.front();
+      if ( var.elem_type == TE_Type::TOKEN ) { // Keyword or Operator
+	auto name = var.tk->aspects.front().s;
+	if ( is_global( name ) ) {
+	  emit( op_t::CONST, add_const( tk ) ); // global procedures are their own value
+	} else {
+	  emit( op_t::FAIL, add_str( "Variable does not exist: " + *name ) );
+	}
+      } else if ( is_global( var.s ) ) {
+	emit( op_t::CONST, add_const( tk ) );
+      } else if ( expr->slot == psil_parser::FREE_SLOT ) {
+	emit( op_t::LOCAL, add_name( var.s ) );
+      } else if ( expr->slot != psil_parser::NO_SLOT ) {
+	emit( op_t::ARG, add_name( var.s ), uint32_t( expr->depth ) << 16 | expr->slot );
+      } else {
+	emit( op_t::VAR, add_name( var.s ) );
+      }
+      return;
+    }
+    case NK::LAMBDA:
+      emit( op_t::CLOSURE, add_const( tk ) );
+      return;
+    case NK::CONDITIONAL:
+      conditional( expr );
+      return;
+    case NK::APPLICATION:
+      application( expr );
+      return;
+    default:
+      emit( op_t::FAIL, add_str( "Unknown expression type" ) );
+      return;
+    }
+  }
+
+  void compiler_t::definition( const token_ptr & tk ) {
+    bool define = tk->head == HK::DEFINE;
+    if ( !define && tk->head != HK::UPDATE ) {
+      emit( op_t::FAIL, add_str( "Unknown definition type" ) );
+      return;
+    }
+    //                           <variable>    <identifier>
+    size_t iden = add_name( tk->aspects[0].tk->aspects.front().tk->aspects.front().s );
+    emit( define ? op_t::CHECK_DEFINE : op_t::CHECK_UPDATE, iden );
+    expression( tk->aspects[1].tk );
+    emit( define ? op_t::DEFINE : op_t::UPDATE, iden );
+  }
+
+  // === If runs one of two branches, cond runs its branch or leaves void
+  void compiler_t::conditional( const token_ptr & tk ) {
+    expression( tk->aspects[0].tk );
+    size_t to_else = emit( op_t::JUMP_FALSE );
+    expression( tk->aspects[1].tk );
+    size_t to_end = emit( op_t::JUMP );
+    chunk.code[to_else].a = chunk.code.size();
+    if ( tk->head == HK::COND ) {
+      emit( op_t::VOID );
+    } else {
+      expression( tk->aspects[2].tk );
+    }
+    chunk.code[to_end].a = chunk.code.size();
+  }
+
+  void compiler_t::application( const token_ptr & tk ) {
+    auto & fn = tk->aspects.front().tk;
+    bool quote = false;
+    size_t global = 0;
+    bool is_global_call = false;
+    // === Function, keywords and operators name global procedures ===
+    if ( fn->head == HK::NONE && fn->aspects.size() == 1 &&
+	 fn->aspects.front().elem_type == TE_Type::TOKEN &&
+	 fn->aspects.front().tk->kind == NK::VARIABLE &&
+	 fn->aspects.front().tk->aspects.front().tk->aspects.front().elem_type == TE_Type::TOKEN ) {
+      //                 <variable>               <identifier>        <keyword>
+      auto proc = fn->aspects.front().tk->aspects.front().tk->aspects.front().tk.get();
+      auto & name = proc->aspects.front().str();
+      if ( proc->kind != NK::OPERATOR && !is_global( proc->aspects.front().s ) ) {
+	emit( op_t::FAIL, add_str( "Could not find proc" ) );
+	return;
+      }
+      chunk.globals.push_back( global_t{ fn.share(), name } );
+      global = chunk.globals.size() - 1;
+      is_global_call = true;
+      quote = name == "to_quote";
+    } else {
+      expression( fn );
+      emit( op_t::CHECK_FN );
+    }
+
+    // === Arguments ===
+    // As in the tree engine, the argument after one that is void is passed as written
+    size_t count = tk->aspects.size() - 1;
+    size_t skip = SIZE_MAX;
+    for ( size_t i = 1; i <= count; ++i ) {
+      auto & arg = tk->aspects[i].tk;
+      if ( quote ) { // to_quote is given code, not values
+	emit( op_t::QUOTE, add_const( arg ) );
+	continue;
+      }
+      expression( arg );
+      if ( skip != SIZE_MAX ) { chunk.code[skip].b = chunk.code.size(); }
+      skip = SIZE_MAX;
+      if ( i < count ) {
+	skip = emit( op_t::SKIP_VOID, add_const( tk->aspects[i+1].tk ) );
+      }
+    }
+    if ( is_global_call ) {
+      emit( op_t::CALL_GLOBAL, global, count );
+    } else {
+      emit( op_t::CALL, count );
+    }
+  }
+
+  // === Jumps to the end of the chunk return at once, so calls before them are tail calls
+  void compiler_t::finish() {
+    emit( op_t::RETURN );
+    for ( auto & in : chunk.code ) {
+      if ( in.op != op_t::JUMP ) { continue; }
+      size_t to = in.a;
+      while ( chunk.code[to].op == op_t::JUMP ) { to = chunk.code[to].a; }
+      if ( chunk.code[to].op == op_t::RETURN ) { in.op = op_t::RETURN; }
+    }
+  }
+
+  // ========== Virtual Machine =======================================
+
+  // Apply global procedure to the values from first on, void values are left out
+  static bool apply_global( stack_ptr & s, std::vector<token_ptr> & vals, size_t first,
+			    const token_ptr & fn, const std::string & name, token_ptr & node ) {
+    auto app = psil_parser::make_token( NK::APPLICATION, HK::PAREN );
+    app->aspects.reserve( vals.size() - first + 1 );
+    app->aspects.emplace_back( fn.share() );
+    for ( size_t i = first; i < vals.size(); ++i ) {
+      if ( vals[i] != nullptr ) { app->aspects.emplace_back( std::move( vals[i] ) ); }
+    }
+    node = psil_parser::make_token( NK::EXPRESSION );
+    node->aspects.emplace_back( std::move( app ) );
+    bool rem = false;
+    psil_exec::apply_global_proc( s, node, rem, name );
+    return rem;
+  }
+
+  // === Whether the call ending at pc is in tail position, what follows it only returns its result
+  // Begins it ends may follow, if their other results are void, those are counted in drop,
+  //  and the scopes they pop in pops
+  static bool tail_call( const chunk_t * chunk, size_t pc, const std::vector<token_ptr> & vals,
+			 size_t below, size_t & drop, size_t & pops ) {
+    drop = 0;
+    pops = 0;
+    while ( true ) {
+      const instr_t & in = chunk->code[pc];
+      switch ( in.op ) {
+      case op_t::RETURN:
+	return true;
+      case op_t::JUMP:
+	pc = in.a;
+	break;
+      case op_t::COLLECT:
+	for ( size_t i = 1; i < in.a; ++i ) {
+	  if ( vals[below - drop - i] != nullptr ) { return false; }
+	}
+	drop += in.a - 1;
+	++pc;
+	break;
+      case op_t::POP_SCOPE:
+	++pops;
+	++pc;
+	break;
+      default:
+	return false;
+      }
+    }
+  }
+
+  // === Compile and run ast
+  void vm_t::run( stack_ptr & s, token_ptr & ast, bool& rem ) {
+    chunk_t chunk;
+    compiler_t compiler( s, chunk );
+    compiler.node( ast );
+    compiler.finish();
+    vals.clear(); // left over from a run that failed
+    calls.clear();
+    exec( s, &chunk );
+    rem = vals.empty() || vals.back() == nullptr;
+    vals.clear();
+  }
+
+  // Bodies kept before the first sweep
+  static const size_t MIN_SWEEP = 256;
+
+  // === Chunk of lambda body, compiled when the body is first applied
+  const chunk_t * vm_t::body_of( stack_ptr & s, token_t * lambda ) {
+    auto & body = lambda->aspects[1].tk;
+    auto itr = bodies.find( body.get() );
+    if ( itr != bodies.end() ) { return &itr->second.chunk; }
+    if ( bodies.size() >= sweep_at ) { sweep(); }
+    auto & entry = bodies[ body.get() ];
+    entry.body = body.share();
+    compiler_t compiler( s, entry.chunk );
+    compiler.expression( body->aspects.front().tk );
+    compiler.finish();
+    return &entry.chunk;
+  }
+
+  // === Forget chunks of bodies nothing else holds, no lambda can apply them again
+  // Running bodies are held by their calls, so their chunks stay
+  void vm_t::sweep() {
+    for ( auto itr = bodies.begin(); itr != bodies.end(); ) {
+      if ( itr->second.body.shared() ) {
+	++itr;
+      } else {
+	itr = bodies.erase( itr );
+      }
+    }
+    sweep_at = std::max( MIN_SWEEP, 2 * bodies.size() );
+  }
+
+  // === Push result of variable or global procedure, void if rem is set
+  // Results that are not values are compiled and run in their place, as exec runs them again,
+  //  such as the code of unquote or arguments passed as written
+  void vm_t::result( stack_ptr & s, bool rem, token_ptr & node, const chunk_t *& chunk, size_t & pc,
+		     token_ptr & running ) {
+    if ( rem ) {
+      vals.emplace_back();
+    } else if ( psil_exec::is_value( node ) ) {
+      vals.push_back( std::move( node ) );
+    } else {
+      auto code = std::make_unique<chunk_t>();
+      compiler_t compiler( s, *code );
+      compiler.expression( node );
+      compiler.finish();
+      calls.push_back( call_t{ chunk, pc, s->env.share(), std::move( code ), 0, std::move( running ) } );
+      chunk = calls.back().owned.get();
+      pc = 0;
+    }
+  }
+
+  // === Dispatch loop
+  void vm_t::exec( stack_ptr & s, const chunk_t * chunk ) {
+    size_t depth = calls.size();
+    size_t pc = 0;
+    token_ptr running; // body of chunk, if it is a lambda body
+    while ( true ) {
+      const instr_t & in = chunk->code[pc++];
+      switch ( in.op ) {
+      case op_t::CONST:
+	vals.push_back( chunk->consts[in.a].share() );
+	break;
+      case op_t::QUOTE: {
+	auto code = chunk->consts[in.a].share();
+	psil_exec::write_frame( s, code );
+	vals.push_back( std::move( code ) );
+	break;
+      }
+      case op_t::VAR:
+      case op_t::ARG:
+      case op_t::LOCAL: {
+	auto name = chunk->names[in.a];
+	const token_ptr * arg = nullptr;
+	if ( in.op == op_t::ARG ) {
+	  arg = psil_exec::find_arg( s->env.get(), in.b >> 16, in.b & 0xffff, name );
+	} else if ( in.op == op_t::VAR ) {
+	  arg = psil_exec::find_arg( s->env.get(), name );
+	}
+	if ( arg == nullptr ) {
+	  ExistsType ret;
+	  auto elem = s->find( name, ret );
+	  if ( ret != ExistsType::LOCAL ) { // globals are constants
+	    throw std::string( "Variable does not exist: " + *name );
+	  }
+	  arg = &elem->value;
+	}
+	// Code passed as written runs here, not where its addresses were given
+	token_ptr value = psil_exec::is_value( *arg ) ? arg->share() : psil_exec::copy_unresolved( *arg );
+	result( s, false, value, chunk, pc, running );
+	break;
+      }
+      case op_t::CLOSURE: {
+	auto value = chunk->consts[in.a].share();
+	if ( value->aspects.front().tk->vtype != VarType::PROC ) {
+	  psil_exec::make_closure( s, value );
+	}
+	vals.push_back( std::move( value ) );
+	break;
+      }
+      case op_t::CHECK_DEFINE: {
+	auto iden = chunk->names[in.a];
+	auto ret = s->exists( iden );
+	if ( ret == ExistsType::GLOBAL ) {
+	  throw std::string( "Cannot redefine a global procedure "+*iden );
+	} else if ( ret == ExistsType::LOCAL ) {
+	  throw std::string( "Cannot redefine a local variable, use update "+*iden );
+	}
+	break;
+      }
+      case op_t::DEFINE: {
+	auto iden = chunk->names[in.a];
+	if ( vals.back() == nullptr ) { throw std::string( "Update error "+*iden ); }
+	s->add( iden, vals.back() );
+	vals.back().reset(); // definitions leave no value
+	break;
+      }
+      case op_t::CHECK_UPDATE: {
+	auto iden = chunk->names[in.a];
+	auto ret = s->exists( iden );
+	if ( ret == ExistsType::GLOBAL ) {
+	  throw std::string( "Cannot update a global procedure "+*iden );
+	} else if ( ret == ExistsType::NO ) {
+	  throw std::string( "Cannot set a variable that has not been defined "+*iden );
+	}
+	break;
+      }
+      case op_t::UPDATE: {
+	auto iden = chunk->names[in.a];
+	if ( vals.back() == nullptr ) { throw std::string( "Update error "+*iden ); }
+	s->update( iden, ExistsType::LOCAL, vals.back() );
+	vals.back().reset();
+	break;
+      }
+      case op_t::PUSH_SCOPE:
+	s->push();
+	break;
+      case op_t::POP_SCOPE:
+	s->pop();
+	break;
+      case op_t::JUMP:
+	pc = in.a;
+	break;
+      case op_t::JUMP_FALSE: {
+	auto value = std::move( vals.back() );
+	vals.pop_back();
+	if ( value != nullptr && !psil_exec::is_true( s, value ) ) { pc = in.a; }
+	break;
+      }
+      case op_t::VOID:
+	vals.emplace_back();
+	break;
+      case op_t::COLLECT: {
+	// One value left is the value of begin, more are left in a begin expression
+	size_t first = vals.size() - in.a;
+	size_t left = 0, last = first;
+	for ( size_t i = first; i < vals.size(); ++i ) {
+	  if ( vals[i] != nullptr ) { ++left; last = i; }
+	}
+	token_ptr ret;
+	if ( left == 1 ) {
+	  ret = std::move( vals[last] );
+	} else if ( left > 1 ) {
+	  ret = psil_parser::make_token( NK::EXPRESSION, HK::BEGIN );
+	  for ( size_t i = first; i < vals.size(); ++i ) {
+	    if ( vals[i] != nullptr ) { ret->aspects.emplace_back( std::move( vals[i] ) ); }
+	  }
+	}
+	vals.resize( first );
+	vals.push_back( std::move( ret ) );
+	break;
+      }
+      case op_t::CHECK_FN: {
+	auto & fn = vals.back();
+	if ( fn == nullptr ) {
+	  throw std::string( "Missing function in application expression" );
+	}
+	if ( fn->aspects.size() == 1 && fn->aspects.front().elem_type == TE_Type::TOKEN &&
+	     fn->aspects.front().tk->kind == NK::CONSTANT ) {
+	  throw std::string( "Cannot apply a constant" );
+	}
+	break;
+      }
+      case op_t::SKIP_VOID:
+	if ( vals.back() == nullptr ) { // void is left out by the call
+	  vals.push_back( chunk->consts[in.a].share() );
+	  pc = in.b;
+	}
+	break;
+      case op_t::CALL: {
+	size_t first = vals.size() - in.a;
+	auto fn = std::move( vals[first-1] );
+	auto f = fn->aspects.size() == 1 && fn->aspects.front().elem_type == TE_Type::TOKEN ?
+	  fn->aspects.front().tk.get() : nullptr;
+	if ( f != nullptr && f->kind == NK::VARIABLE ) { // global procedure given as value
+	  auto & iden = f->aspects.front().tk->aspects.front();
+	  const std::string & name = iden.elem_type == TE_Type::TOKEN ?
+	    iden.tk->aspects.front().str() : iden.str();
+	  token_ptr node;
+	  bool rem = apply_global( s, vals, first, fn, name, node );
+	  vals.resize( first - 1 );
+	  result( s, rem, node, chunk, pc, running );
+	  break;
+	}
+	if ( f == nullptr || f->kind != NK::LAMBDA ) {
+	  throw std::string( "Missing function in application expression" );
+	}
+	// === Bind arguments in a new frame, as apply_lambda does ===
+	auto formals = f->aspects[0].tk.get();
+	size_t given = 0;
+	for ( size_t i = first; i < vals.size(); ++i ) {
+	  if ( vals[i] != nullptr ) { ++given; }
+	}
+	if ( formals->aspects.size() != given ) { // Arity Error
+	  std::string err = "Arity mismatch, expected:" + std::to_string( formals->aspects.size() );
+	  err += " given:" + std::to_string( given );
+	  throw std::string( err );
+	}
+	auto frame = psil_parser::make_token( NK::FRAME );
+	frame->aspects.reserve( 2 * given + 1 );
+	size_t i = first;
+	for ( auto & formal : formals->aspects ) {
+	  while ( vals[i] == nullptr ) { ++i; }
+	  //                    <variable>      <identifier>
+	  frame->aspects.emplace_back( formal.tk->aspects.front().tk->aspects.front().s );
+	  frame->aspects.emplace_back( std::move( vals[i++] ) );
+	}
+	if ( f->vtype != VarType::PROC ) {
+	  if ( s->env != nullptr ) { frame->aspects.emplace_back( s->env.share() ); }
+	} else if ( f->aspects.size() > 2 ) {
+	  frame->aspects.emplace_back( f->aspects[2].tk.share() );
+	}
+	auto body = body_of( s, f );
+	vals.resize( first - 1 );
+	// Call in tail position reuses the call it is made from, which restores the caller frame
+	//  Empty scopes of begins it ends are popped now, as exec does, others when the call returns
+	size_t drop = 0, pops = 0;
+	if ( calls.size() == depth || !tail_call( chunk, pc, vals, first - 1, drop, pops ) ) {
+	  if ( calls.size() >= s->max_depth ) { throw std::string( "Stack depth exceeded" ); }
+	  calls.push_back( call_t{ chunk, pc, std::move( s->env ), nullptr, 0, std::move( running ) } );
+	} else {
+	  vals.resize( first - 1 - drop );
+	  for ( ; pops > 0 && s->table.back().empty(); --pops ) { s->pop(); }
+	  calls.back().scopes += pops;
+	}
+	s->env = std::move( frame );
+	running = f->aspects[1].tk.share();
+	chunk = body;
+	pc = 0;
+	break;
+      }
+      case op_t::CALL_GLOBAL: {
+	auto & g = chunk->globals[in.a];
+	size_t first = vals.size() - in.b;
+	token_ptr node;
+	bool rem = apply_global( s, vals, first, g.fn, g.name, node );
+	vals.resize( first );
+	result( s, rem, node, chunk, pc, running );
+	break;
+      }
+      case op_t::FAIL:
+	throw std::string( chunk->strs[in.a] );
+      case op_t::RETURN: {
+	if ( calls.size() == depth ) { return; }
+	auto & call = calls.back();
+	for ( ; call.scopes > 0; --call.scopes ) { s->pop(); }
+	chunk = call.chunk;
+	pc = call.pc;
+	s->env = std::move( call.env );
+	running = std::move( call.body );
+	calls.pop_back(); // frees chunk of code made while running, after leaving it
+	break;
+      }
+      }
+    }
+  }
+
+}
@@ -0,0 +1,165 @@
+/**
+    psil_vm.h
+    PSIL Bytecode Virtual Machine
+    @author Sinclair Gurny
+    @version 1.0
+    July 2019
+ */
+
+#pragma once
+
+#include "psil_exec.h"
+#include <unordered_map>
+
+namespace psil_vm {
+
+  // ===================================================================================
+  // === Typedefs ======================================================================
+  // ===================================================================================
+
+  using TE_Type = psil_parser::token_elem_t::TE_Type;
+  using NK = psil_parser::node_kind;
+  using HK = psil_parser::head_kind;
+  using token_t = psil_parser::token_t;
+  using token_ptr = psil_parser::token_ptr;
+  using stack_ptr = psil_exec::stack_ptr;
+
+  // ===================================================================================
+  // === Bytecode ======================================================================
+  // ===================================================================================
+
+  /**
+     Operation codes, a and b are the operands of the instruction
+     Values are the same value expressions the tree engine makes,
+       void results (definitions, print, ...) are pushed as nullptr
+  */
+  enum class op_t : uint8_t {
+    CONST,        // push consts[a]
+    VAR,          // push value of variable names[a], looked up by name
+    ARG,          // push argument names[a] at lexical address b, depth << 16 | slot
+    LOCAL,        // push value of variable names[a] from the symbol tables, no lambda binds it
+    QUOTE,        // push code consts[a] with the arguments of the running frame written in
+    CLOSURE,      // push lambda consts[a] closed over running frame
+    CHECK_DEFINE, // make sure names[a] can be defined, before its value is run
+    DEFINE,       // pop value and define names[a] as it, push void
+    CHECK_UPDATE, // make sure names[a] can be updated, before its value is run
+    UPDATE,       // pop value and update names[a] to it, push void
+    PUSH_SCOPE,   // push symbol table
+    POP_SCOPE,    // pop symbol table
+    JUMP,         // go to a
+    JUMP_FALSE,   // pop value, go to a if it is false, void counts as true
+    VOID,         // push void
+    COLLECT,      // pop a results of begin, push what is left of them
+    CHECK_FN,     // make sure top of stack can be applied
+    SKIP_VOID,    // if top is void, push consts[a] as written and go to b
+    CALL,         // apply value under a arguments to them
+    CALL_GLOBAL,  // apply global procedure globals[a] to a arguments
+    FAIL,         // throw strs[a]
+    RETURN        // leave chunk, result is on top
+  };
+
+  struct instr_t {
+    op_t op;
+    uint32_t a;
+    uint32_t b;
+  };
+
+  /**
+     Global procedure called by name, fn is the variable expression naming it
+  */
+  struct global_t {
+    token_ptr fn;
+    std::string name;
+  };
+
+  /**
+     Chunk
+     Bytecode of one form or lambda body, with the tokens and names it refers to
+  */
+  struct chunk_t {
+    std::vector<instr_t> code;
+    std::vector<token_ptr> consts;
+    std::vector<const std::string *> names; // interned, looked up in frames by pointer
+    std::vector<std::string> strs;
+    std::vector<global_t> globals;
+  };
+
+  // ===================================================================================
+  // === Compiler ======================================================================
+  // ===================================================================================
+
+  /**
+     Compiles the checked and lowered tree into a chunk
+     Global procedures are resolved against the global table of the stack
+  */
+  class compiler_t {
+  public:
+    compiler_t( const stack_ptr & s, chunk_t & c ) : stack(s), chunk(c) {}
+
+    // <program>, <form>, <definition> or <expression>, leaves one value
+    void node( const token_ptr & tk );
+    void expression( const token_ptr & tk );
+    void definition( const token_ptr & tk );
+    void conditional( const token_ptr & tk );
+    void application( const token_ptr & tk );
+    // <begin> of form or expression, scope is pushed when scoped
+    void begin( const token_ptr & tk, bool scoped );
+    void finish();
+
+  private:
+    size_t emit( op_t op, size_t a = 0, size_t b = 0 );
+    size_t add_const( const token_ptr & tk );
+    size_t add_str( const std::string & s );
+    size_t add_name( const std::string * n );
+    bool is_global( const std::string * n ) const;
+
+    const stack_ptr & stack;
+    chunk_t & chunk;
+  };
+
+  // ===================================================================================
+  // === Virtual Machine ===============================================================
+  // ===================================================================================
+
+  /**
+     Virtual Machine
+     Runs chunks with a value stack and a stack of calls, so lambdas do not
+       recurse on the C++ stack
+     Arguments are bound in the same frames the tree engine uses, and global
+       procedures are applied by it, so both engines print the same output
+     Lambda bodies are compiled the first time they are applied and kept by body,
+       until nothing but the vm holds the body
+  */
+  class vm_t {
+  public:
+    // Run checked and lowered tree, rem is set when it leaves no value
+    void run( stack_ptr & s, token_ptr & ast, bool& rem );
+
+  private:
+    struct call_t {
+      const chunk_t * chunk;
+      size_t pc;
+      token_ptr env; // frame of caller
+      std::unique_ptr<chunk_t> owned; // chunk of code made while running
+      size_t scopes; // scopes of begins left by tail calls, popped when the call returns
+      token_ptr body; // body chunk is compiled from, so it is kept while the call is running
+    };
+
+    struct body_t {
+      token_ptr body; // keeps body, so its address is not reused
+      chunk_t chunk;
+    };
+
+    void exec( stack_ptr & s, const chunk_t * chunk );
+    const chunk_t * body_of( stack_ptr & s, token_t * lambda );
+    void sweep();
+    void result( stack_ptr & s, bool rem, token_ptr & node, const chunk_t *& chunk, size_t & pc,
+		 token_ptr & running );
+
+    std::vector<token_ptr> vals;
+    std::vector<call_t> calls;
+    std::unordered_map<const token_t *, body_t> bodies;
+    size_t sweep_at = 0; // size of bodies that starts the next sweep
+  };
+
+}
@@ -31,12 +31,37 @@ int main( int argc, char ** argv ) {
   // Make PSIL Language
   auto psil_lang = psil::make_psil_lang();
 
+  // === Flags ===
+  bool use_vm = false; // --vm runs code with the bytecode vm
+  size_t max_depth = psil_exec::DEFAULT_MAX_DEPTH; // --max-depth <n> limits nested lambda calls
+  while ( argc > 1 && std::string( argv[1] ).rfind( "--", 0 ) == 0 ) {
+    std::string flag( argv[1] );
+    if ( flag == "--vm" ) {
+      use_vm = true;
+    } else if ( flag == "--max-depth" && argc > 2 ) {
+      char * end = nullptr;
+      unsigned long long n = std::strtoull( argv[2], &end, 10 );
+      if ( *argv[2] == '\0' || *argv[2] == '-' || *end != '\0' || n == 0 ) {
+	std::cerr << "Invalid max depth given" << std::endl;
+	return 1;
+      }
+      max_depth = n;
+      --argc;
+      ++argv;
+    } else {
+      std::cerr << "Invalid flag given: " << flag << std::endl;
+      return 1;
+    }
+    --argc;
+    ++argv;
+  }
+
   // === Run PSIL source code file ===
   if ( argc > 1 ) {
     std::string filename(argv[1]);
     size_t pos = filename.find( ".psil" );
     if ( pos != std::string::npos && pos == filename.size()-5) {
-      psil::run_file( psil_lang, filename );
+      psil::run_file( psil_lang, filename, use_vm, max_depth );
     } else {
       std::cerr << "Invalid file given" << std::endl;
     }
@@ -82,7 +107,7 @@ int main( int argc, char ** argv ) {
       continue;
     }
 
-    psil::repl( psil_lang, tmp_buf );
+    psil::repl( psil_lang, tmp_buf, use_vm, max_depth );
   }
 
   return 0;